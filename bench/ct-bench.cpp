@@ -0,0 +1,564 @@
+//
+// Benchmarks of the message passing kernels and of the solver on synthetic
+// instances (see `generator.hpp`).
+//
+// Every benchmark is repeated `--repetitions` times and the minimum and the
+// median are reported in nanoseconds per unit of work (e.g. per detection
+// for one sweep of `send_messages` over the whole graph). All results are
+// written as a single JSON document to stdout or `--output`, so that runs of
+// different versions can be compared.
+//
+// The `options/*` benchmarks solve the instance with non-default solver
+// options (adaptive conflict rounds, damped transition messages,
+// extrapolation, initial reparametrization), compare their bounds and times
+// with `run`. The initialization is part of the untimed setup.
+//
+// The `schedule/*` benchmarks compare full passes with the cache-blocked
+// schedule (see `tracker::set_tiling`) and the parallel even/odd passes
+// (see `tracker::set_parallel`, one run per `--threads` value above one) at
+// the same number of iterations.
+//
+// Besides the microbenchmarks there are two scaling sweeps: `--sizes` solves
+// instances with the given numbers of cells per frame and `--threads` solves
+// that many independent instances concurrently (throughput of the batch
+// mode, every tracker runs on one thread).
+//
+// `--write FILE` writes the instance in the `*.ct` format and exits.
+//
+
+#include <ct.hpp>
+
+#include "generator.hpp"
+
+#include <array>
+#include <thread>
+
+#include <getopt.h>
+
+// Set by the build system.
+#ifndef LIBCT_VERSION
+#define LIBCT_VERSION "unknown"
+#endif
+
+namespace {
+
+using allocator_type = ct::block_allocator<ct::cost>;
+using tracker_type = ct::tracker<allocator_type>;
+using clock_type = std::chrono::steady_clock;
+using seconds_type = std::chrono::duration<double>;
+
+// Same memory setup as the trackers of the C API.
+struct solver {
+  ct::memory_block memory;
+  ct::memory_block cost_memory;
+  allocator_type allocator;
+  allocator_type cost_allocator;
+  tracker_type tracker;
+
+  solver(const ct::bench::instance& inst)
+  : allocator(memory)
+  , cost_allocator(cost_memory)
+  , tracker(allocator, cost_allocator)
+  {
+    ct::bench::build(tracker.get_graph(), inst);
+    memory.finalize();
+    cost_memory.finalize();
+    tracker.set_verbose(false);
+    tracker.invalidate_cached_minima();
+  }
+
+  const auto& timesteps() const { return tracker.get_graph().timesteps(); }
+
+  template<typename FUNCTOR>
+  void for_each_detection(FUNCTOR f) const
+  {
+    for (const auto& t : timesteps())
+      for (const auto* node : t.detections)
+        f(node);
+  }
+
+  template<typename FUNCTOR>
+  void for_each_conflict(FUNCTOR f) const
+  {
+    for (const auto& t : timesteps())
+      for (const auto* node : t.conflicts)
+        f(node);
+  }
+};
+
+struct options {
+  ct::bench::instance_parameters instance;
+  int repetitions = 5;
+  int iterations = 100;
+  std::vector<int> sizes = { 100, 200, 400, 800 };
+  std::vector<int> threads = { 1, 2, 4 };
+  std::string filter;
+  std::string output;
+  std::string write;
+};
+
+struct result {
+  std::string name;
+  std::string unit;          // unit of work the timings refer to
+  double units;              // per repetition
+  std::vector<double> seconds;
+  std::vector<std::pair<std::string, double>> extra;
+};
+
+
+class json_writer {
+public:
+  json_writer(std::ostream& out)
+  : out_(out)
+  {
+    out_.precision(std::numeric_limits<double>::max_digits10);
+  }
+
+  static std::string quote(const std::string& s)
+  {
+    std::string result = "\"";
+    for (char c : s) {
+      if (c == '"' || c == '\\')
+        result += '\\';
+      result += c;
+    }
+    return result + "\"";
+  }
+
+  // Non-finite numbers are not valid JSON.
+  void number(double value)
+  {
+    if (std::isfinite(value))
+      out_ << value;
+    else
+      out_ << "null";
+  }
+
+  void write(const options& o, const std::vector<result>& results)
+  {
+    const auto& p = o.instance;
+    out_ << "{\n";
+    out_ << "  \"library\": \"libct\",\n";
+    out_ << "  \"version\": " << quote(LIBCT_VERSION) << ",\n";
+    out_ << "  \"simd\": " << quote(level_name(ct::simd::get_level())) << ",\n";
+    out_ << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out_ << "  \"repetitions\": " << o.repetitions << ",\n";
+    out_ << "  \"iterations\": " << o.iterations << ",\n";
+    out_ << "  \"instance\": {"
+         << "\"frames\": " << p.frames << ", "
+         << "\"cells\": " << p.cells << ", "
+         << "\"candidates\": " << p.candidates << ", "
+         << "\"division_rate\": " << p.division_rate << ", "
+         << "\"conflict_density\": " << p.conflict_density << ", "
+         << "\"conflict_size\": " << p.conflict_size << ", "
+         << "\"noise\": " << p.noise << ", "
+         << "\"seed\": " << p.seed << "},\n";
+    out_ << "  \"results\": [";
+
+    bool first = true;
+    for (const auto& r : results) {
+      auto sorted = r.seconds;
+      std::sort(sorted.begin(), sorted.end());
+      const double scale = 1e9 / r.units;
+
+      out_ << (first ? "\n" : ",\n") << "    {\"name\": " << quote(r.name)
+           << ", \"unit\": " << quote(r.unit)
+           << ", \"units\": " << r.units
+           << ", \"min_ns\": ";
+      number(sorted.front() * scale);
+      out_ << ", \"median_ns\": ";
+      number(sorted[sorted.size() / 2] * scale);
+      for (const auto& [key, value] : r.extra) {
+        out_ << ", " << quote(key) << ": ";
+        number(value);
+      }
+      out_ << "}";
+      first = false;
+    }
+    out_ << "\n  ]\n}\n";
+  }
+
+  static const char* level_name(ct::simd::level l)
+  {
+    switch (l) {
+      case ct::simd::level::avx512: return "avx512";
+      case ct::simd::level::avx2: return "avx2";
+      default: return "scalar";
+    }
+  }
+
+protected:
+  std::ostream& out_;
+};
+
+
+class benchmark_suite {
+public:
+  benchmark_suite(const options& o)
+  : options_(o)
+  , instance_(ct::bench::generate(o.instance))
+  { }
+
+  const std::vector<result>& results() const { return results_; }
+
+  void run()
+  {
+    kernels();
+    simd_kernels();
+    solver_run();
+    solver_options();
+    schedules();
+    size_sweep();
+    thread_sweep();
+  }
+
+protected:
+  bool selected(const std::string& name) const
+  {
+    return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+  }
+
+  // Runs `setup` (untimed) and `functor` (timed) for every repetition.
+  template<typename SETUP, typename FUNCTOR>
+  void measure(const std::string& name, const std::string& unit, double units, SETUP setup, FUNCTOR functor)
+  {
+    if (!selected(name))
+      return;
+
+    result r { name, unit, units, {}, {} };
+    for (int i = 0; i < options_.repetitions; ++i) {
+      setup();
+      const auto begin = clock_type::now();
+      functor(r);
+      r.seconds.push_back(seconds_type(clock_type::now() - begin).count());
+    }
+    std::cerr << "[bench] " << name << std::endl;
+    results_.push_back(std::move(r));
+  }
+
+  template<typename FUNCTOR>
+  void measure(const std::string& name, const std::string& unit, double units, FUNCTOR functor)
+  {
+    measure(name, unit, units, []() { }, functor);
+  }
+
+  void kernels()
+  {
+    solver s(instance_);
+    const double detections = instance_.number_of_detections();
+    const double conflicts = instance_.conflicts.size();
+
+    // A few sweeps first, so that the costs are not in their initial state.
+    for (int i = 0; i < 10; ++i) {
+      s.tracker.forward_pass();
+      s.tracker.backward_pass();
+    }
+
+    measure("transition_messages/forward", "detection", detections, [&](auto&) {
+      s.for_each_detection([](const auto* node) { ct::transition_messages::send_messages<true>(node); });
+    });
+    measure("transition_messages/backward", "detection", detections, [&](auto&) {
+      s.for_each_detection([](const auto* node) { ct::transition_messages::send_messages<false>(node); });
+    });
+    measure("transition_messages/forward_grouped", "detection", detections, [&](auto&) {
+      for (const auto& t : s.timesteps())
+        ct::transition_messages::send_messages<true>(t);
+    });
+    measure("transition_messages/backward_grouped", "detection", detections, [&](auto&) {
+      for (const auto& t : s.timesteps())
+        ct::transition_messages::send_messages<false>(t);
+    });
+
+    if (conflicts > 0) {
+      measure("conflict_messages/to_conflict", "conflict", conflicts, [&](auto&) {
+        s.for_each_conflict([](const auto* node) { ct::conflict_messages::send_messages_to_conflict(node); });
+      });
+      measure("conflict_messages/to_detection", "conflict", conflicts, [&](auto&) {
+        s.for_each_conflict([](const auto* node) { ct::conflict_messages::send_messages_to_detection(node); });
+      });
+    }
+
+    std::array<bool, ct::max_number_of_detection_edges + 1> possible;
+    possible.fill(true);
+    measure("round_primal", "detection", detections,
+      [&]() { s.tracker.reset_primal(); },
+      [&](auto&) {
+        s.for_each_detection([&](const auto* node) { node->factor.template round_primal<true>(possible); });
+      });
+
+    measure("lower_bound", "detection", detections, [&](auto& r) {
+      r.extra = { { "lower_bound", s.tracker.lower_bound() } };
+    });
+  }
+
+  void simd_kernels()
+  {
+    const auto original = ct::simd::get_level();
+    std::vector<ct::cost> values(64);
+    ct::bench::random_source random(options_.instance.seed);
+    for (auto& v : values)
+      v = random.symmetric();
+
+    constexpr int calls = 100000;
+    for (auto l : { ct::simd::level::scalar, ct::simd::level::avx2, ct::simd::level::avx512 }) {
+      if (l > ct::simd::supported_level())
+        continue;
+
+      ct::simd::set_level(l);
+      const std::string level = json_writer::level_name(l);
+      for (int n : { 4, 8, 16, 32, 64 }) {
+        volatile ct::cost sink;
+        const auto suffix = "/" + level + "/" + std::to_string(n);
+        measure("simd/min_value" + suffix, "call", calls, [&](auto&) {
+          for (int i = 0; i < calls; ++i)
+            sink = ct::simd::min_value(values.data(), values.data() + n);
+        });
+        measure("simd/least_two_values" + suffix, "call", calls, [&](auto&) {
+          for (int i = 0; i < calls; ++i)
+            sink = std::get<1>(ct::simd::least_two_values(values.data(), values.data() + n));
+        });
+      }
+    }
+    ct::simd::set_level(original);
+  }
+
+  // Full solver iterations, every repetition starts from a fresh tracker
+  // (`configure` is applied to it before the timing starts).
+  template<typename CONFIGURE>
+  void solve(const std::string& name, const ct::bench::instance& inst, CONFIGURE configure)
+  {
+    std::unique_ptr<solver> s;
+    measure(name, "iteration", options_.iterations,
+      [&]() { s.reset(); s = std::make_unique<solver>(inst); configure(s->tracker); },
+      [&](auto& r) {
+        s->tracker.run(options_.iterations);
+        r.extra = { { "detections", static_cast<double>(inst.number_of_detections()) },
+                    { "lower_bound", s->tracker.lower_bound() },
+                    { "upper_bound", s->tracker.evaluate_primal() } };
+      });
+  }
+
+  void solve(const std::string& name, const ct::bench::instance& inst)
+  {
+    solve(name, inst, [](auto&) { });
+  }
+
+  void solver_run()
+  {
+    solve("run", instance_);
+  }
+
+  void solver_options()
+  {
+    solve("options/conflict_rounds/adaptive", instance_, [](auto& tracker) {
+      tracker.set_conflict_rounds(1, 10, 1e-3);
+    });
+    solve("options/transition_damping/0.5", instance_, [&](auto& tracker) {
+      tracker.set_transition_damping(0.5, options_.iterations / 2);
+    });
+    solve("options/extrapolation/5", instance_, [](auto& tracker) {
+      tracker.set_extrapolation(5, 1.0);
+    });
+    solve("options/initialize", instance_, [](auto& tracker) {
+      tracker.initialize();
+    });
+  }
+
+  void schedules()
+  {
+    solve("schedule/full", instance_);
+    for (int sweeps : { 2, 5, 10 }) {
+      const auto name = "schedule/tiled/" + std::to_string(sweeps);
+      size_t tiles = 0;
+      solve(name, instance_, [&](auto& tracker) {
+        tracker.set_tiling(sweeps);
+        tiles = tracker.tiles().size();
+      });
+      if (!results_.empty() && results_.back().name == name)
+        results_.back().extra.push_back({ "tiles", static_cast<double>(tiles) });
+    }
+
+    for (int threads : options_.threads) {
+      if (threads <= 1)
+        continue;
+      solve("schedule/parallel/" + std::to_string(threads), instance_, [&](auto& tracker) {
+        tracker.set_parallel(threads);
+      });
+    }
+  }
+
+  void size_sweep()
+  {
+    for (int cells : options_.sizes) {
+      const auto name = "scaling/cells/" + std::to_string(cells);
+      if (!selected(name))
+        continue;
+      auto p = options_.instance;
+      p.cells = cells;
+      solve(name, ct::bench::generate(p));
+    }
+  }
+
+  void thread_sweep()
+  {
+    for (int threads : options_.threads) {
+      const auto name = "scaling/threads/" + std::to_string(threads);
+      if (!selected(name) || threads < 1)
+        continue;
+
+      std::vector<ct::bench::instance> instances;
+      for (int i = 0; i < threads; ++i) {
+        auto p = options_.instance;
+        p.seed += i;
+        instances.push_back(ct::bench::generate(p));
+      }
+
+      std::vector<std::unique_ptr<solver>> solvers(threads);
+      measure(name, "model", threads,
+        [&]() {
+          for (int i = 0; i < threads; ++i) {
+            solvers[i].reset();
+            solvers[i] = std::make_unique<solver>(instances[i]);
+          }
+        },
+        [&](auto&) {
+          std::vector<std::thread> workers;
+          for (int i = 0; i < threads; ++i)
+            workers.emplace_back([&, i]() { solvers[i]->tracker.run(options_.iterations); });
+          for (auto& w : workers)
+            w.join();
+        });
+    }
+  }
+
+  const options& options_;
+  ct::bench::instance instance_;
+  std::vector<result> results_;
+};
+
+
+std::vector<int> parse_list(const char* s)
+{
+  std::vector<int> result;
+  std::istringstream in(s);
+  std::string item;
+  while (std::getline(in, item, ','))
+    if (!item.empty())
+      result.push_back(std::stoi(item));
+  return result;
+}
+
+void usage(const char* argv0)
+{
+  std::cerr << "Usage: " << argv0 << " [options]\n"
+            << "\n"
+            << "Instance:\n"
+            << "  --frames N              frames (default 50)\n"
+            << "  --cells N               cells per frame (default 200)\n"
+            << "  --candidates N          candidate transitions per cell (default 3)\n"
+            << "  --division-rate P       probability of a division candidate (default 0.05)\n"
+            << "  --conflict-density P    probability that a cell starts a conflict set (default 0.25)\n"
+            << "  --conflict-size N       cells per conflict set (default 2)\n"
+            << "  --noise X               amplitude of the cost noise (default 1)\n"
+            << "  --seed N                random seed (default 42)\n"
+            << "  --write FILE            write the instance as *.ct file and exit\n"
+            << "\n"
+            << "Benchmarks:\n"
+            << "  --repetitions N         repetitions per benchmark (default 5)\n"
+            << "  --iterations N          solver iterations per run (default 100)\n"
+            << "  --sizes N,N,...         cells per frame of the scaling sweep (default 100,200,400,800)\n"
+            << "  --threads N,N,...       concurrent models of the scaling sweep and threads\n"
+            << "                          of schedule/parallel (default 1,2,4)\n"
+            << "  --filter SUBSTRING      only run benchmarks whose name contains SUBSTRING\n"
+            << "  --output FILE           write the JSON results to FILE instead of stdout\n";
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  enum { opt_frames = 256, opt_cells, opt_candidates, opt_division_rate,
+         opt_conflict_density, opt_conflict_size, opt_noise, opt_seed, opt_write,
+         opt_repetitions, opt_iterations, opt_sizes, opt_threads, opt_filter,
+         opt_output, opt_help };
+
+  static const option long_options[] = {
+    { "frames", required_argument, nullptr, opt_frames },
+    { "cells", required_argument, nullptr, opt_cells },
+    { "candidates", required_argument, nullptr, opt_candidates },
+    { "division-rate", required_argument, nullptr, opt_division_rate },
+    { "conflict-density", required_argument, nullptr, opt_conflict_density },
+    { "conflict-size", required_argument, nullptr, opt_conflict_size },
+    { "noise", required_argument, nullptr, opt_noise },
+    { "seed", required_argument, nullptr, opt_seed },
+    { "write", required_argument, nullptr, opt_write },
+    { "repetitions", required_argument, nullptr, opt_repetitions },
+    { "iterations", required_argument, nullptr, opt_iterations },
+    { "sizes", required_argument, nullptr, opt_sizes },
+    { "threads", required_argument, nullptr, opt_threads },
+    { "filter", required_argument, nullptr, opt_filter },
+    { "output", required_argument, nullptr, opt_output },
+    { "help", no_argument, nullptr, opt_help },
+    { nullptr, 0, nullptr, 0 }
+  };
+
+  options o;
+  try {
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+      switch (c) {
+        case opt_frames: o.instance.frames = std::stoi(optarg); break;
+        case opt_cells: o.instance.cells = std::stoi(optarg); break;
+        case opt_candidates: o.instance.candidates = std::stoi(optarg); break;
+        case opt_division_rate: o.instance.division_rate = std::stod(optarg); break;
+        case opt_conflict_density: o.instance.conflict_density = std::stod(optarg); break;
+        case opt_conflict_size: o.instance.conflict_size = std::stoi(optarg); break;
+        case opt_noise: o.instance.noise = std::stod(optarg); break;
+        case opt_seed: o.instance.seed = std::stoul(optarg); break;
+        case opt_write: o.write = optarg; break;
+        case opt_repetitions: o.repetitions = std::stoi(optarg); break;
+        case opt_iterations: o.iterations = std::stoi(optarg); break;
+        case opt_sizes: o.sizes = parse_list(optarg); break;
+        case opt_threads: o.threads = parse_list(optarg); break;
+        case opt_filter: o.filter = optarg; break;
+        case opt_output: o.output = optarg; break;
+        case opt_help: usage(argv[0]); return 0;
+        default: usage(argv[0]); return 2;
+      }
+    }
+  } catch (const std::exception&) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if (optind != argc || o.instance.frames < 1 || o.instance.cells < 1 ||
+      o.instance.candidates < 1 || o.instance.candidates > static_cast<int>(ct::max_number_of_detection_edges) - 2 ||
+      o.repetitions < 1 || o.iterations < 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if (!o.write.empty()) {
+    std::ofstream out(o.write);
+    ct::bench::write_txt(out, ct::bench::generate(o.instance));
+    return out ? 0 : 1;
+  }
+
+  benchmark_suite suite(o);
+  suite.run();
+
+  if (o.output.empty()) {
+    json_writer(std::cout).write(o, suite.results());
+  } else {
+    std::ofstream out(o.output);
+    json_writer(out).write(o, suite.results());
+    if (!out) {
+      std::cerr << "Could not write " << o.output << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
@@ -0,0 +1,222 @@
+#ifndef LIBCT_BENCH_GENERATOR_HPP
+#define LIBCT_BENCH_GENERATOR_HPP
+
+#include <algorithm>
+#include <cstdlib>
+#include <ostream>
+#include <random>
+#include <vector>
+
+namespace ct::bench {
+
+//
+// Scalable synthetic cell tracking instances.
+//
+// Every frame contains the same number of cells. Cell `d` of one frame
+// truly continues as cell `d` of the next frame, the candidate transitions
+// go to the `candidates` cells around that index. The farther a candidate
+// is away from the true successor, the more expensive it is. Divisions
+// go to two neighboring cells. Conflict sets consist of `conflict_size`
+// consecutive cells (e.g. overlapping segmentation hypotheses). All costs
+// get uniform noise of the given amplitude.
+//
+// The random numbers are derived from the raw output of `std::mt19937`
+// only, so an instance is the same for all compilers and standard
+// libraries.
+//
+
+struct instance_parameters {
+  int frames = 50;
+  int cells = 200;                // per frame
+  int candidates = 3;             // transitions per cell
+  double division_rate = 0.05;    // probability that a cell may divide
+  double conflict_density = 0.25; // probability that a cell starts a conflict set
+  int conflict_size = 2;          // cells per conflict set
+  double noise = 1.0;
+  unsigned seed = 42;
+};
+
+struct instance {
+  struct detection {
+    double cost, appearance, disappearance;
+    int number_of_incoming = 0;
+    int number_of_outgoing = 0;
+    int number_of_conflicts = 0;
+  };
+
+  // The costs of transitions and divisions are total costs, `build` splits
+  // them among the attached detections like the Python frontend does.
+  struct transition {
+    int timestep;
+    int from, to_1, to_2;      // `to_2` is negative for moves
+    double cost;
+    int slot_from, slot_to_1, slot_to_2;
+  };
+
+  struct conflict {
+    int timestep;
+    std::vector<int> detections, slots;
+  };
+
+  std::vector<std::vector<detection>> timesteps;
+  std::vector<transition> transitions;
+  std::vector<conflict> conflicts;
+
+  size_t number_of_detections() const
+  {
+    size_t result = 0;
+    for (const auto& t : timesteps)
+      result += t.size();
+    return result;
+  }
+};
+
+class random_source {
+public:
+  random_source(unsigned seed)
+  : engine_(seed)
+  { }
+
+  // Uniform in [0, 1).
+  double uniform() { return engine_() / 4294967296.0; }
+
+  // Uniform in [-1, 1).
+  double symmetric() { return 2.0 * uniform() - 1.0; }
+
+  bool chance(double probability) { return uniform() < probability; }
+
+protected:
+  std::mt19937 engine_;
+};
+
+inline instance generate(const instance_parameters& p)
+{
+  instance result;
+  random_source r(p.seed);
+  const int n = p.cells;
+  auto wrap = [n](int d) { return ((d % n) + n) % n; };
+
+  result.timesteps.resize(p.frames);
+  for (auto& t : result.timesteps) {
+    t.resize(n);
+    for (auto& d : t) {
+      d.cost = -1.0 + p.noise * r.symmetric();
+      d.appearance = 1.0 + p.noise * r.uniform();
+      d.disappearance = 1.0 + p.noise * r.uniform();
+    }
+  }
+
+  for (int t = 0; t + 1 < p.frames; ++t) {
+    auto& here = result.timesteps[t];
+    auto& next = result.timesteps[t + 1];
+    for (int d = 0; d < n; ++d) {
+      for (int k = 0; k < std::min(p.candidates, n); ++k) {
+        const int offset = k - std::min(p.candidates, n) / 2;
+        const int to = wrap(d + offset);
+        const double cost = 0.5 * std::abs(offset) + 0.5 * p.noise * r.uniform();
+        result.transitions.push_back({t, d, to, -1, cost, here[d].number_of_outgoing++, next[to].number_of_incoming++, -1});
+      }
+
+      if (n >= 2 && r.chance(p.division_rate)) {
+        const int to_1 = d, to_2 = wrap(d + 1);
+        const double cost = 2.0 + p.noise * r.uniform();
+        result.transitions.push_back({t, d, to_1, to_2, cost, here[d].number_of_outgoing++,
+                                      next[to_1].number_of_incoming++, next[to_2].number_of_incoming++});
+      }
+    }
+  }
+
+  if (p.conflict_size >= 2 && p.conflict_size <= n) {
+    for (int t = 0; t < p.frames; ++t) {
+      for (int d = 0; d < n; ++d) {
+        if (!r.chance(p.conflict_density))
+          continue;
+
+        instance::conflict c;
+        c.timestep = t;
+        for (int i = 0; i < p.conflict_size; ++i) {
+          auto& detection = result.timesteps[t][wrap(d + i)];
+          c.detections.push_back(wrap(d + i));
+          c.slots.push_back(detection.number_of_conflicts++);
+        }
+        result.conflicts.push_back(std::move(c));
+      }
+    }
+  }
+
+  return result;
+}
+
+// Adds the instance to an empty graph.
+template<typename GRAPH>
+void build(GRAPH& graph, const instance& inst)
+{
+  auto conflict = inst.conflicts.begin(); // sorted by timestep
+
+  for (size_t t = 0; t < inst.timesteps.size(); ++t) {
+    for (size_t d = 0; d < inst.timesteps[t].size(); ++d) {
+      const auto& det = inst.timesteps[t][d];
+      auto* node = graph.add_detection(t, d, det.number_of_incoming, det.number_of_outgoing, det.number_of_conflicts);
+      node->factor.set_detection_cost(det.cost);
+      node->factor.set_appearance_cost(det.appearance);
+      node->factor.set_disappearance_cost(det.disappearance);
+    }
+
+    // The costs of the conflict factors are zero initially.
+    for (int idx = 0; conflict != inst.conflicts.end() && conflict->timestep == static_cast<int>(t); ++conflict, ++idx) {
+      graph.add_conflict(t, idx, conflict->detections.size());
+      for (size_t i = 0; i < conflict->detections.size(); ++i)
+        graph.add_conflict_link(t, idx, i, conflict->detections[i], conflict->slots[i]);
+    }
+  }
+
+  for (const auto& e : inst.transitions) {
+    if (e.to_2 < 0)
+      graph.add_transition(e.timestep, e.from, e.slot_from, e.to_1, e.slot_to_1);
+    else
+      graph.add_division(e.timestep, e.from, e.slot_from, e.to_1, e.slot_to_1, e.to_2, e.slot_to_2);
+    graph.set_transition_cost(e.timestep, e.from, e.slot_from, e.cost);
+  }
+}
+
+// Writes the instance in the `*.ct` text format (see `ct.txt`), so that it
+// can be solved by `ct-batch` or the Python frontend as well.
+inline void write_txt(std::ostream& out, const instance& inst)
+{
+  std::vector<std::vector<int>> ids(inst.timesteps.size());
+  int next_id = 0;
+
+  out.precision(17);
+  out << "# synthetic instance\n";
+  for (size_t t = 0; t < inst.timesteps.size(); ++t) {
+    for (const auto& d : inst.timesteps[t]) {
+      const int id = next_id++;
+      ids[t].push_back(id);
+      out << "H " << t << " " << id << " " << d.cost << "\n";
+      out << "APP " << next_id++ << " " << id << " " << d.appearance << "\n";
+      out << "DISAPP " << next_id++ << " " << id << " " << d.disappearance << "\n";
+    }
+  }
+
+  for (const auto& c : inst.conflicts) {
+    out << "CONFSET";
+    for (size_t i = 0; i < c.detections.size(); ++i)
+      out << (i > 0 ? " + " : " ") << ids[c.timestep][c.detections[i]];
+    out << " <= 1\n";
+  }
+
+  for (const auto& e : inst.transitions) {
+    const auto& from = ids[e.timestep];
+    const auto& to = ids[e.timestep + 1];
+    if (e.to_2 < 0)
+      out << "MOVE " << next_id++ << " " << from[e.from] << " " << to[e.to_1] << " " << e.cost << "\n";
+    else
+      out << "DIV " << next_id++ << " " << from[e.from] << " " << to[e.to_1] << " " << to[e.to_2] << " " << e.cost << "\n";
+  }
+}
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
@@ -0,0 +1,617 @@
+//
+// Native batch driver: Solves many *.ct models in parallel.
+//
+// Every input file is solved by its own tracker. The trackers come from a
+// shared `ct_tracker_pool`, so their arenas and Gurobi environments are
+// reused across models. Models are handed out dynamically (largest input
+// file first), so that a few big models do not end up behind a long tail of
+// small ones. The solution of `path/model.ct` (or `path/model.ct.xz`) is
+// written to `path/model.sol`. For every model one JSON object is emitted
+// as a single line (in order of completion) to stdout or to `--summary`.
+//
+
+#include <ct.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <getopt.h>
+#include <glob.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+namespace {
+
+//
+// Model in the `*.ct` text format, see `ct.txt.parse_txt_model`.
+//
+// Detections are numbered per timestep in the order of the input file and
+// transitions/divisions are enumerated in file order, i.e. exactly as the
+// Python frontend does it. Hence, the solution files are identical.
+//
+
+struct txt_detection {
+  int timestep;
+  int index;
+  int unique_id;
+  int appearance_id = -1;
+  int disappearance_id = -1;
+  double cost;
+  double appearance = std::numeric_limits<double>::quiet_NaN();
+  double disappearance = std::numeric_limits<double>::quiet_NaN();
+  int number_of_incoming = 0;
+  int number_of_outgoing = 0;
+};
+
+struct txt_transition {
+  int unique_id;
+  double cost;
+  size_t from, to_1, to_2;   // `to_2` is unused for moves
+  int slot_from, slot_to_1, slot_to_2;
+};
+
+struct txt_conflict {
+  int timestep;
+  std::vector<size_t> detections;
+};
+
+struct txt_model {
+  std::vector<txt_detection> detections;
+  std::vector<std::vector<size_t>> timesteps;
+  std::vector<txt_transition> transitions;
+  std::vector<txt_transition> divisions;
+  std::vector<txt_conflict> conflicts;
+  std::unordered_map<int, size_t> ids;
+
+  size_t detection_by_id(int unique_id) const
+  {
+    auto it = ids.find(unique_id);
+    if (it == ids.end())
+      throw std::runtime_error("Unknown detection id " + std::to_string(unique_id));
+    return it->second;
+  }
+};
+
+
+class line_parser {
+public:
+  line_parser(const char* line)
+  : pos_(line)
+  { }
+
+  bool keyword(const char* word)
+  {
+    const auto length = std::strlen(word);
+    if (std::strncmp(pos_, word, length) != 0 || (pos_[length] != ' ' && pos_[length] != '\t'))
+      return false;
+    pos_ += length;
+    return true;
+  }
+
+  int integer()
+  {
+    char* end;
+    errno = 0;
+    const long value = std::strtol(pos_, &end, 10);
+    if (end == pos_ || errno != 0)
+      throw std::runtime_error("Expected integer");
+    pos_ = end;
+    return static_cast<int>(value);
+  }
+
+  double real()
+  {
+    char* end;
+    const double value = std::strtod(pos_, &end);
+    if (end == pos_)
+      throw std::runtime_error("Expected number");
+    pos_ = end;
+    return value;
+  }
+
+  // Consumes `+` between the detections of a conflict set and reports
+  // whether another detection follows.
+  bool next_summand()
+  {
+    skip_space();
+    if (*pos_ != '+')
+      return false;
+    ++pos_;
+    return true;
+  }
+
+  const char* rest()
+  {
+    skip_space();
+    return pos_;
+  }
+
+protected:
+  void skip_space()
+  {
+    while (*pos_ == ' ' || *pos_ == '\t')
+      ++pos_;
+  }
+
+  const char* pos_;
+};
+
+
+std::string quote_shell(const std::string& s)
+{
+  std::string result = "'";
+  for (char c : s) {
+    if (c == '\'')
+      result += "'\\''";
+    else
+      result += c;
+  }
+  return result + "'";
+}
+
+bool ends_with(const std::string& s, const std::string& suffix)
+{
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+txt_model parse_model(const std::string& filename)
+{
+  const bool compressed = ends_with(filename, ".xz");
+  FILE* f = compressed ? popen(("xz -dc -- " + quote_shell(filename)).c_str(), "r")
+                       : std::fopen(filename.c_str(), "r");
+  if (f == nullptr)
+    throw std::runtime_error("Could not open " + filename);
+
+  txt_model m;
+  std::unordered_map<size_t, int> outgoing_slots, incoming_slots;
+
+  auto add_detection = [&](int timestep, int unique_id, double cost) {
+    if (timestep < 0)
+      throw std::runtime_error("Negative timestep");
+    if (static_cast<size_t>(timestep) >= m.timesteps.size())
+      m.timesteps.resize(timestep + 1);
+    txt_detection d;
+    d.timestep = timestep;
+    d.index = m.timesteps[timestep].size();
+    d.unique_id = unique_id;
+    d.cost = cost;
+    m.timesteps[timestep].push_back(m.detections.size());
+    m.ids[unique_id] = m.detections.size();
+    m.detections.push_back(d);
+  };
+
+  auto check_successor = [&](size_t from, size_t to) {
+    if (m.detections[from].timestep + 1 != m.detections[to].timestep)
+      throw std::runtime_error("Transition does not connect consecutive timesteps");
+  };
+
+  char* line = nullptr;
+  size_t capacity = 0;
+  ssize_t length;
+  size_t line_number = 0;
+  try {
+    while ((length = getline(&line, &capacity, f)) != -1) {
+      ++line_number;
+      while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+        line[--length] = '\0';
+      if (length == 0 || line[0] == '#')
+        continue;
+
+      line_parser p(line);
+      if (p.keyword("H")) {
+        const int timestep = p.integer();
+        const int unique_id = p.integer();
+        add_detection(timestep, unique_id, p.real());
+      } else if (p.keyword("APP") || p.keyword("DISAPP")) {
+        const bool appearance = line[0] == 'A';
+        const int unique_id = p.integer();
+        auto& d = m.detections[m.detection_by_id(p.integer())];
+        (appearance ? d.appearance_id : d.disappearance_id) = unique_id;
+        (appearance ? d.appearance : d.disappearance) = p.real();
+      } else if (p.keyword("MOVE")) {
+        txt_transition e;
+        e.unique_id = p.integer();
+        e.from = m.detection_by_id(p.integer());
+        e.to_1 = m.detection_by_id(p.integer());
+        e.cost = p.real();
+        check_successor(e.from, e.to_1);
+        e.slot_from = outgoing_slots[e.from]++;
+        e.slot_to_1 = incoming_slots[e.to_1]++;
+        m.transitions.push_back(e);
+      } else if (p.keyword("DIV")) {
+        txt_transition e;
+        e.unique_id = p.integer();
+        e.from = m.detection_by_id(p.integer());
+        e.to_1 = m.detection_by_id(p.integer());
+        e.to_2 = m.detection_by_id(p.integer());
+        e.cost = p.real();
+        check_successor(e.from, e.to_1);
+        check_successor(e.from, e.to_2);
+        e.slot_from = outgoing_slots[e.from]++;
+        e.slot_to_1 = incoming_slots[e.to_1]++;
+        e.slot_to_2 = incoming_slots[e.to_2]++;
+        m.divisions.push_back(e);
+      } else if (p.keyword("CONFSET")) {
+        txt_conflict c;
+        do {
+          c.detections.push_back(m.detection_by_id(p.integer()));
+        } while (p.next_summand());
+        if (std::strcmp(p.rest(), "<= 1") != 0)
+          throw std::runtime_error("Expected `<= 1`");
+        c.timestep = m.detections[c.detections.front()].timestep;
+        for (auto d : c.detections)
+          if (m.detections[d].timestep != c.timestep)
+            throw std::runtime_error("Conflict spans multiple timesteps");
+        m.conflicts.push_back(std::move(c));
+      } else {
+        throw std::runtime_error("Unhandled input line");
+      }
+    }
+  } catch (const std::runtime_error& e) {
+    std::free(line);
+    compressed ? pclose(f) : std::fclose(f);
+    throw std::runtime_error(filename + ":" + std::to_string(line_number) + ": " + e.what());
+  }
+
+  std::free(line);
+  const int status = compressed ? pclose(f) : std::fclose(f);
+  if (status != 0)
+    throw std::runtime_error("Could not read " + filename);
+
+  for (const auto& [d, n] : outgoing_slots)
+    m.detections[d].number_of_outgoing = n;
+  for (const auto& [d, n] : incoming_slots)
+    m.detections[d].number_of_incoming = n;
+
+  for (const auto& d : m.detections)
+    if (std::isnan(d.appearance) || std::isnan(d.disappearance))
+      throw std::runtime_error(filename + ": Detection " + std::to_string(d.unique_id) + " lacks an appearance or disappearance cost");
+
+  return m;
+}
+
+// Same construction as `ct.tracker.construct_tracker`.
+void construct_graph(const txt_model& m, ct_tracker* t)
+{
+  ct_graph* g = ct_tracker_get_graph(t);
+
+  std::vector<std::vector<const txt_conflict*>> conflicts(m.timesteps.size());
+  for (const auto& c : m.conflicts)
+    conflicts[c.timestep].push_back(&c);
+
+  std::unordered_map<size_t, int> conflict_slots;
+  for (size_t timestep = 0; timestep < m.timesteps.size(); ++timestep) {
+    conflict_slots.clear();
+    for (const auto* c : conflicts[timestep])
+      for (auto d : c->detections)
+        ++conflict_slots[d];
+
+    for (auto i : m.timesteps[timestep]) {
+      const auto& d = m.detections[i];
+      ct_detection* node = ct_graph_add_detection(g, timestep, d.index, d.number_of_incoming, d.number_of_outgoing, conflict_slots[i]);
+      ct_detection_set_detection_cost(node, d.cost);
+      ct_detection_set_appearance_cost(node, d.appearance);
+      ct_detection_set_disappearance_cost(node, d.disappearance);
+    }
+
+    conflict_slots.clear();
+    for (size_t c = 0; c < conflicts[timestep].size(); ++c) {
+      const auto& detections = conflicts[timestep][c]->detections;
+      ct_graph_add_conflict(g, timestep, c, detections.size());
+      for (size_t slot = 0; slot < detections.size(); ++slot) {
+        const auto d = detections[slot];
+        ct_graph_add_conflict_link(g, timestep, c, slot, m.detections[d].index, conflict_slots[d]++);
+      }
+    }
+  }
+
+  for (const auto& e : m.transitions) {
+    ct_graph_add_transition(g, m.detections[e.from].timestep, m.detections[e.from].index, e.slot_from,
+                            m.detections[e.to_1].index, e.slot_to_1);
+    ct_graph_set_transition_cost(g, m.detections[e.from].timestep, m.detections[e.from].index, e.slot_from, e.cost);
+  }
+
+  for (const auto& e : m.divisions) {
+    ct_graph_add_division(g, m.detections[e.from].timestep, m.detections[e.from].index, e.slot_from,
+                          m.detections[e.to_1].index, e.slot_to_1, m.detections[e.to_2].index, e.slot_to_2);
+    ct_graph_set_transition_cost(g, m.detections[e.from].timestep, m.detections[e.from].index, e.slot_from, e.cost);
+  }
+
+  ct_tracker_finalize(t);
+}
+
+int write_solution(const txt_model& m, ct_tracker* t, const std::string& filename)
+{
+  std::vector<int> detection_ids, appearance_ids, disappearance_ids, transition_ids, division_ids;
+  for (const auto& timestep : m.timesteps) {
+    for (auto i : timestep) {
+      detection_ids.push_back(m.detections[i].unique_id);
+      appearance_ids.push_back(m.detections[i].appearance_id);
+      disappearance_ids.push_back(m.detections[i].disappearance_id);
+    }
+  }
+  for (const auto& e : m.transitions)
+    transition_ids.push_back(e.unique_id);
+  for (const auto& e : m.divisions)
+    division_ids.push_back(e.unique_id);
+
+  return ct_tracker_write_solution(t, filename.c_str(),
+    detection_ids.data(), detection_ids.size(),
+    appearance_ids.data(), appearance_ids.size(),
+    disappearance_ids.data(), disappearance_ids.size(),
+    transition_ids.data(), transition_ids.size(),
+    division_ids.data(), division_ids.size());
+}
+
+
+//
+// Batch processing.
+//
+
+struct job {
+  std::string input;
+  std::string output;
+  off_t size;
+};
+
+struct options {
+  int max_iterations = 200;
+  int jobs = 0;
+  std::string summary;
+};
+
+volatile std::sig_atomic_t interrupted = 0;
+
+void on_interrupt(int) { interrupted = 1; }
+
+std::string solution_filename(std::string input)
+{
+  for (const char* suffix : {".xz", ".ct"})
+    if (ends_with(input, suffix))
+      input.resize(input.size() - std::strlen(suffix));
+  return input + ".sol";
+}
+
+std::string json_string(const std::string& s)
+{
+  std::string result = "\"";
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (c < 0x20) {
+      char buffer[8];
+      std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      result += buffer;
+    } else {
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+
+std::string json_number(double x)
+{
+  if (!std::isfinite(x))
+    return "null";
+  char buffer[32];
+  const auto result = std::to_chars(buffer, buffer + sizeof(buffer), x);
+  return std::string(buffer, result.ptr);
+}
+
+long long max_rss_bytes()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<long long>(usage.ru_maxrss) * 1024;
+}
+
+std::string solve(const job& j, ct_tracker* t, int max_iterations)
+{
+  using clock = std::chrono::steady_clock;
+  auto seconds_since = [](clock::time_point begin) {
+    return std::chrono::duration<double>(clock::now() - begin).count();
+  };
+  const auto begin = clock::now();
+
+  std::ostringstream s;
+  s << "{\"input\": " << json_string(j.input);
+
+  try {
+    const txt_model m = parse_model(j.input);
+    construct_graph(m, t);
+    const double seconds_setup = seconds_since(begin);
+
+    ct_progress last = {};
+    ct_tracker_set_verbose(t, 0);
+    ct_tracker_set_handle_signals(t, 1);
+    ct_tracker_set_progress_callback(t, [](const ct_progress* p, void* user_data) {
+      *static_cast<ct_progress*>(user_data) = *p;
+      return 0;
+    }, &last);
+    ct_tracker_run(t, max_iterations);
+    ct_tracker_set_progress_callback(t, nullptr, nullptr);
+
+    const double lb = ct_tracker_lower_bound(t);
+    const double ub = ct_tracker_evaluate_primal(t);
+    if (write_solution(m, t, j.output) != 0)
+      throw std::runtime_error("Could not write " + j.output);
+
+    s << ", \"output\": " << json_string(j.output)
+      << ", \"status\": \"ok\""
+      << ", \"timesteps\": " << m.timesteps.size()
+      << ", \"detections\": " << m.detections.size()
+      << ", \"lower_bound\": " << json_number(lb)
+      << ", \"upper_bound\": " << json_number(ub)
+      << ", \"gap\": " << json_number(std::abs((ub - lb) / lb))
+      << ", \"iterations\": " << last.iterations
+      << ", \"seconds\": " << json_number(seconds_since(begin))
+      << ", \"seconds_setup\": " << json_number(seconds_setup)
+      << ", \"arena_bytes\": " << ct_tracker_get_memory_usage(t)
+      << ", \"max_rss_bytes\": " << max_rss_bytes();
+  } catch (const std::exception& e) {
+    s << ", \"status\": \"error\", \"message\": " << json_string(e.what());
+  }
+
+  s << "}";
+  return s.str();
+}
+
+void usage(const char* program)
+{
+  std::cerr << "Usage: " << program << " [OPTION]... INPUT...\n"
+            << "Solves many *.ct cell tracking models in parallel. Every INPUT is a *.ct(.xz)\n"
+            << "file or a (quoted) glob pattern. Solutions are written next to the inputs.\n\n"
+            << "  --maxIterations N   iterations per model (default 200)\n"
+            << "  --jobs N            number of models solved at once (default: number of CPUs)\n"
+            << "  --list FILE         reads additional inputs from FILE, one per line (- is stdin)\n"
+            << "  --summary FILE      writes the JSON lines to FILE instead of stdout\n";
+}
+
+void add_inputs(const std::string& pattern, std::vector<std::string>& inputs)
+{
+  if (pattern.find_first_of("*?[") == std::string::npos) {
+    inputs.push_back(pattern);
+    return;
+  }
+
+  glob_t g;
+  if (glob(pattern.c_str(), 0, nullptr, &g) == 0)
+    inputs.insert(inputs.end(), g.gl_pathv, g.gl_pathv + g.gl_pathc);
+  else
+    std::cerr << "[ct-batch] No match for " << pattern << std::endl;
+  globfree(&g);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+  options opts;
+  std::vector<std::string> inputs;
+
+  const option long_options[] = {
+    { "maxIterations", required_argument, nullptr, 'i' },
+    { "jobs",          required_argument, nullptr, 'j' },
+    { "list",          required_argument, nullptr, 'l' },
+    { "summary",       required_argument, nullptr, 's' },
+    { "help",          no_argument,       nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 }
+  };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "j:h", long_options, nullptr)) != -1) {
+    switch (c) {
+    case 'i': opts.max_iterations = std::atoi(optarg); break;
+    case 'j': opts.jobs = std::atoi(optarg); break;
+    case 's': opts.summary = optarg; break;
+    case 'l': {
+      std::ifstream file;
+      const bool use_stdin = std::strcmp(optarg, "-") == 0;
+      if (!use_stdin) {
+        file.open(optarg);
+        if (!file) {
+          std::cerr << "[ct-batch] Could not open " << optarg << std::endl;
+          return 1;
+        }
+      }
+      std::string line;
+      while (std::getline(use_stdin ? std::cin : file, line))
+        if (!line.empty())
+          add_inputs(line, inputs);
+      break;
+    }
+    case 'h': usage(argv[0]); return 0;
+    default: usage(argv[0]); return 1;
+    }
+  }
+
+  for (int i = optind; i < argc; ++i)
+    add_inputs(argv[i], inputs);
+
+  if (inputs.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<job> jobs;
+  for (const auto& input : inputs) {
+    struct stat st;
+    jobs.push_back({ input, solution_filename(input), stat(input.c_str(), &st) == 0 ? st.st_size : 0 });
+  }
+  // Longest processing time first: The file size is a cheap proxy for the
+  // size of the model.
+  std::stable_sort(jobs.begin(), jobs.end(), [](const job& a, const job& b) { return a.size > b.size; });
+
+  if (opts.jobs <= 0)
+    opts.jobs = std::max(1u, std::thread::hardware_concurrency());
+  opts.jobs = std::min<int>(opts.jobs, jobs.size());
+
+  std::ofstream summary_file;
+  if (!opts.summary.empty()) {
+    summary_file.open(opts.summary);
+    if (!summary_file) {
+      std::cerr << "[ct-batch] Could not open " << opts.summary << std::endl;
+      return 1;
+    }
+  }
+  std::ostream& summary = opts.summary.empty() ? std::cout : summary_file;
+
+  // The trackers install their own SIGINT handler while running and re-raise
+  // the signal afterwards, which ends up here and stops the scheduling.
+  std::signal(SIGINT, on_interrupt);
+
+  ct_tracker_pool* pool = ct_tracker_pool_create(opts.jobs);
+  std::atomic<size_t> next(0);
+  std::atomic<int> failures(0);
+  std::mutex summary_mutex;
+
+  auto worker = [&]() {
+    for (size_t i; !interrupted && (i = next++) < jobs.size();) {
+      ct_tracker* t = ct_tracker_pool_acquire(pool);
+      const std::string result = solve(jobs[i], t, opts.max_iterations);
+      ct_tracker_pool_release(pool, t);
+
+      if (result.find("\"status\": \"ok\"") == std::string::npos)
+        ++failures;
+
+      std::lock_guard<std::mutex> lock(summary_mutex);
+      summary << result << std::endl;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < opts.jobs; ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads)
+    thread.join();
+
+  ct_tracker_pool_destroy(pool);
+
+  if (interrupted) {
+    std::cerr << "[ct-batch] Interrupted, " << jobs.size() - std::min(next.load(), jobs.size()) << " models were skipped." << std::endl;
+    return 130;
+  }
+  return failures > 0 ? 1 : 0;
+}
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
@@ -1,23 +1,72 @@
 #ifndef LIBCT_H
 #define LIBCT_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct ct_tracker_t ct_tracker;
+typedef struct ct_tracker_pool_t ct_tracker_pool;
 typedef struct ct_graph_t ct_graph;
 typedef struct ct_detection_t ct_detection;
 typedef struct ct_conflict_t ct_conflict;
 
+// Progress report of ct_tracker_run, see ct_tracker_set_progress_callback.
+// The gap is relative to the lower bound. All times are wall clock seconds
+// accumulated since the start of ct_tracker_run.
+typedef struct ct_progress_t {
+  int iterations;
+  double lower_bound;
+  double upper_bound;
+  double gap;
+  double seconds;
+  double seconds_messages;
+  double seconds_rounding;
+  double seconds_bounds;
+} ct_progress;
+
+// Invoked once per batch. Returning a non-zero value stops the solver after
+// the current batch.
+typedef int (*ct_progress_callback)(const ct_progress* progress, void* user_data);
+
 //
 // tracker API
 //
+// Independent trackers can be constructed and solved concurrently from
+// different threads. A single tracker must only be used by one thread at a
+// time, except for ct_tracker_cancel and ct_tracker_get_snapshot which may be
+// called from any thread.
+//
 
 ct_tracker* ct_tracker_create();
+
+// Out-of-core mode: All graph and cost storage lives in (unlinked) temporary
+// files in `directory` that are mapped into memory. Only a window of
+// timesteps around the current sweep position is kept resident: `lookahead`
+// upcoming timesteps are prefetched asynchronously, processed timesteps are
+// evicted. Returns NULL if the files cannot be created.
+ct_tracker* ct_tracker_create_file_backed(const char* directory, int lookahead);
 void ct_tracker_destroy(ct_tracker* t);
 void ct_tracker_finalize(ct_tracker* t);
 
+
+// Discards the model and all solver state, so that the tracker can be used
+// for the next model. The memory arenas and the Gurobi environment are kept,
+// so the setup cost of ct_tracker_create is not paid again. Settings like
+// the batch size or callbacks are kept as well.
+void ct_tracker_reset(ct_tracker* t);
+
+// Thread-safe pool of reusable trackers for solving many small models.
+// ct_tracker_pool_create pre-warms `size` trackers. Acquiring never blocks
+// (a new tracker is created if none is idle), releasing resets the tracker.
+// Trackers still acquired must be released before the pool is destroyed.
+ct_tracker_pool* ct_tracker_pool_create(int size);
+void ct_tracker_pool_destroy(ct_tracker_pool* pool);
+ct_tracker* ct_tracker_pool_acquire(ct_tracker_pool* pool);
+void ct_tracker_pool_release(ct_tracker_pool* pool, ct_tracker* t);
+
 ct_graph* ct_tracker_get_graph(ct_tracker* t);
 ct_detection* ct_graph_add_detection(ct_graph* g, int timestep, int detection, int number_of_incoming, int number_of_outgoing, int number_of_conflicts);
 ct_conflict* ct_graph_add_conflict(ct_graph* g, int timestep, int conflict, int number_of_detections);
@@ -25,14 +74,252 @@ ct_detection* ct_graph_get_detection(ct_graph* g, int timestep, int detection);
 void ct_graph_add_transition(ct_graph* g, int timestep_from, int detection_from, int index_from, int detection_to, int index_to);
 void ct_graph_add_division(ct_graph* g, int timestep_from, int detection_from, int index_from, int detection_to_1, int index_to_1, int detection_to_2, int index_to_2);
 void ct_graph_add_conflict_link(ct_graph* g, int timestep, int conflict, int conflict_slot, int detection, int detection_slot);
+
+// Sets the cost of the transition or division leaving the given outgoing
+// slot, which must already be added. The cost is split evenly among all
+// attached detections (use this instead of setting the shares via
+// ct_detection_set_incoming_cost/ct_detection_set_outgoing_cost).
+void ct_graph_set_transition_cost(ct_graph* g, int timestep, int detection, int slot, double c);
+
+// Online mode: Enlarges the outgoing side of an existing detection before a
+// new timestep is linked to it. Existing costs and transitions are kept, the
+// new slots must be initialized via ct_detection_set_outgoing_cost.
+void ct_graph_resize_outgoing(ct_graph* g, int timestep, int detection, int number_of_outgoing);
 ct_conflict* ct_graph_get_conflict(ct_graph* g, int timestep, int conflict);
+int ct_graph_get_number_of_detections(ct_graph* g);
+int ct_graph_get_number_of_transitions(ct_graph* g);
+int ct_graph_get_number_of_divisions(ct_graph* g);
+int ct_graph_get_number_of_conflicts(ct_graph* g);
+int ct_graph_get_number_of_timesteps(ct_graph* g);
 
 void ct_tracker_run(ct_tracker* t, int max_iterations);
+void ct_tracker_set_batch_size(ct_tracker* t, int batch_size);
+void ct_tracker_set_verbose(ct_tracker* t, int verbose);
+void ct_tracker_set_progress_callback(ct_tracker* t, ct_progress_callback callback, void* user_data);
+
+// Instrumentation of ct_tracker_run (disabled by default, almost free while
+// disabled). When enabled, the wall time of the solver phases and a few
+// counters are accumulated per batch and per timestep. The phases do not
+// overlap, phases outside of the per-timestep work (evaluation, bounds,
+// primal copies) only show up in the batches and totals. The statistics of
+// the most recent run are kept until the next ct_tracker_run or
+// ct_tracker_reset.
+typedef struct ct_hardware_counters_t {
+  long long cycles;
+  long long instructions;
+  long long llc_misses;
+  long long branch_misses;
+} ct_hardware_counters;
+
+typedef struct ct_instrumentation_t {
+  int iterations; // per batch: iterations at the end of the batch
+  double seconds_conflict_messages;
+  double seconds_transition_messages;
+  double seconds_subsolver;
+  double seconds_rounding_sort;
+  double seconds_rounding;
+  double seconds_evaluate_primal;
+  double seconds_lower_bound;
+  double seconds_primal_copy;
+  long long transition_messages;
+  long long conflict_messages;
+  long long subsolver_calls;
+  long long nodes_rounded;
+  long long candidates_evaluated;
+  // Hardware counters (all zero unless enabled by
+  // ct_tracker_set_hardware_counters). The rounding includes the sorting and
+  // the subsolver.
+  ct_hardware_counters hardware_conflict_messages;
+  ct_hardware_counters hardware_transition_messages;
+  ct_hardware_counters hardware_rounding;
+} ct_instrumentation;
+
+void ct_tracker_set_instrumentation(ct_tracker* t, int enabled);
+int ct_tracker_get_instrumentation_number_of_batches(ct_tracker* t);
+
+// Samples cycles, instructions, LLC misses and branch misses of the solver
+// thread per phase (Linux perf events, user space only). Returns 0 on
+// success and -1 if the counters are not available, e.g. because of
+// kernel.perf_event_paranoid or inside some virtual machines.
+int ct_tracker_set_hardware_counters(ct_tracker* t, int enabled);
+
+// A `batch` of -1 yields the totals of the run. Both functions return 0 on
+// success and -1 if the batch or timestep is out of range.
+int ct_tracker_get_instrumentation(ct_tracker* t, int batch, ct_instrumentation* result);
+int ct_tracker_get_timestep_instrumentation(ct_tracker* t, int timestep, ct_instrumentation* result);
+
+// Writes totals, batches and timesteps as JSON. Returns 0 on success.
+int ct_tracker_write_instrumentation(ct_tracker* t, const char* filename);
+
+// Records a timeline of passes, timesteps, rounding and subsolver calls
+// during ct_tracker_run and writes it to `filename` in the Chrome
+// trace-event format (chrome://tracing, ui.perfetto.dev) when the run ends.
+// At most `events_per_thread` events are kept per thread (<= 0 selects the
+// default), older ones are dropped. A NULL filename disables tracing.
+void ct_tracker_set_trace(ct_tracker* t, const char* filename, int events_per_thread);
+
+// Writes the trace of the most recent run again. Returns 0 on success.
+int ct_tracker_write_trace(ct_tracker* t, const char* filename);
+
+// Requests that the running (or next) ct_tracker_run returns early. The best
+// primal found so far is restored as usual.
+void ct_tracker_cancel(ct_tracker* t);
+
+// Opt-in: stop ct_tracker_run on SIGINT. The signal handler is shared by all
+// trackers of the process which enabled it.
+void ct_tracker_set_handle_signals(ct_tracker* t, int enabled);
+
+// Online mode: Timesteps are appended to the graph of a tracker that is NOT
+// finalized. Each call of ct_tracker_run_window optimizes only the most
+// recent `window_size` timesteps and commits all older ones. It returns
+// after `max_iterations` or when `max_seconds` are used up (soft budget).
+// ct_tracker_commit_window commits the remaining timesteps.
+void ct_tracker_set_window_size(ct_tracker* t, int window_size);
+void ct_tracker_run_window(ct_tracker* t, int max_iterations, double max_seconds);
+void ct_tracker_commit_window(ct_tracker* t);
+int ct_tracker_get_number_of_committed_timesteps(ct_tracker* t);
+
+// Same as ct_tracker_get_primals, but only committed decisions are reported.
+// Detections of uncommitted timesteps and transitions/divisions into an
+// uncommitted timestep are marked with -1.
+int ct_tracker_get_committed_primals(ct_tracker* t, int* detections, size_t detections_size, int* transitions, size_t transitions_size, int* divisions, size_t divisions_size);
+
+
+// Incremental updates of an already solved tracker. The ct_detection_set_*
+// functions would overwrite the current reparametrization, so changes of the
+// original costs are passed as deltas instead. For transitions and
+// divisions the outgoing slot of the source detection is given and the
+// delta is split among all attached detections. ct_tracker_add_costs is the
+// bulk variant: the arrays follow the enumeration order of
+// ct_tracker_get_primals (plus one appearance and disappearance delta per
+// detection), zero entries are skipped. It returns -1 without applying
+// anything if an array size does not match the graph (0 on success).
+// ct_tracker_resolve continues from
+// the current dual state, but iterates only over the touched timesteps plus
+// `margin` timesteps on each side before rounding the whole graph again.
+void ct_tracker_add_detection_cost(ct_tracker* t, int timestep, int detection, double delta);
+void ct_tracker_add_appearance_cost(ct_tracker* t, int timestep, int detection, double delta);
+void ct_tracker_add_disappearance_cost(ct_tracker* t, int timestep, int detection, double delta);
+void ct_tracker_add_transition_cost(ct_tracker* t, int timestep, int detection, int slot, double delta);
+int ct_tracker_add_costs(ct_tracker* t, const double* detection_deltas, size_t detection_deltas_size, const double* appearance_deltas, size_t appearance_deltas_size, const double* disappearance_deltas, size_t disappearance_deltas_size, const double* transition_deltas, size_t transition_deltas_size, const double* division_deltas, size_t division_deltas_size);
+void ct_tracker_resolve(ct_tracker* t, int max_iterations, int margin);
+
+
+// Checkpointing: The solver state (reparametrized costs, best primal, upper
+// bound and iteration count) is stored in a compact binary file. Before
+// loading, the graph must be rebuilt with the same structure (and
+// finalized). Resuming with ct_tracker_run continues with exactly the same
+// bounds. Both functions return 0 on success. ct_tracker_set_checkpoint
+// enables periodic checkpoints during ct_tracker_run, which are written by a
+// background thread (NULL disables them).
+int ct_tracker_save_state(ct_tracker* t, const char* filename);
+int ct_tracker_load_state(ct_tracker* t, const char* filename);
+void ct_tracker_set_checkpoint(ct_tracker* t, const char* filename, double interval_seconds);
+
+// Initial reparametrization (after ct_tracker_finalize, before
+// ct_tracker_run). ct_tracker_initialize improves the even split of the
+// transition costs and moves costs into the conflicts in one sweep, which
+// never decreases the lower bound. Alternatively, the reparametrization of
+// a previous solve of a related model (e.g. with other cost parameters or a
+// similar structure) is used as a warm start: ct_tracker_save_reparametrization
+// stores how the costs of all transitions, divisions and conflicts are
+// distributed (returns 0 on success), ct_tracker_load_reparametrization
+// applies this distribution to all edges and conflict slots that exist in
+// both models. It returns the number of applied entries or -1 on error.
+void ct_tracker_initialize(ct_tracker* t);
+int ct_tracker_save_reparametrization(ct_tracker* t, const char* filename);
+int ct_tracker_load_reparametrization(ct_tracker* t, const char* filename);
+
 double ct_tracker_lower_bound(ct_tracker* t);
 double ct_tracker_evaluate_primal(ct_tracker* t);
+
+// Per-timestep contributions to ct_tracker_lower_bound and
+// ct_tracker_evaluate_primal (without the constant), one entry per
+// timestep. The difference is the local share of the gap. Returns 0 on
+// success and -1 (without writing) if an array size is not the number of
+// timesteps.
+int ct_tracker_get_timestep_bounds(ct_tracker* t, double* lower_bounds, size_t lower_bounds_size, double* upper_bounds, size_t upper_bounds_size);
+
+// After the rounding of every batch, ct_tracker_run performs `sweeps`
+// additional forward/backward passes over the `window_size` consecutive
+// timesteps with the largest local gap. Zero sweeps disable this (default).
+void ct_tracker_set_gap_focus(ct_tracker* t, int window_size, int sweeps);
+
+// Cache-blocked message passing in ct_tracker_run: `sweeps` forward/backward
+// passes within a tile of consecutive timesteps that fits into half of
+// `cache_bytes` (0 selects the L2 cache) before moving on to the next,
+// overlapping tile. Zero sweeps restore full passes (default).
+void ct_tracker_set_tiling(ct_tracker* t, int sweeps, size_t cache_bytes);
+
+// Conflict messages are exchanged in up to `max_rounds` rounds per timestep
+// step. After `min_rounds`, a timestep stops early once a round changes the
+// detection costs of its conflicting detections by at most `tolerance` on
+// average. The default is a fixed number of 5 rounds.
+void ct_tracker_set_conflict_rounds(ct_tracker* t, int min_rounds, int max_rounds, double tolerance);
+
+// Damped transition messages: the message weight grows linearly from
+// `initial_weight` (in (0, 1]) to 1 during the first `ramp_iterations`
+// iterations. The default is no damping.
+void ct_tracker_set_transition_damping(ct_tracker* t, double initial_weight, int ramp_iterations);
+
+// Every `interval` iterations, ct_tracker_run extrapolates all costs along
+// the direction of the last `interval` iterations (step size up to `beta`).
+// A step that would decrease the lower bound is undone. Zero interval
+// disables the extrapolation (default).
+void ct_tracker_set_extrapolation(ct_tracker* t, int interval, double beta);
+
+// Parallel message passing in ct_tracker_run on `threads` threads: every
+// pass updates all even and then all odd timesteps concurrently instead of
+// sweeping sequentially. Needs more iterations than the sequential sweeps,
+// but scales with the number of timesteps. The rounding stays sequential.
+// One thread (default) restores the sequential sweeps.
+void ct_tracker_set_parallel(ct_tracker* t, int threads);
 void ct_tracker_forward_step(ct_tracker* t, int timestep);
 void ct_tracker_backward_step(ct_tracker* t, int timestep);
 
+// Fills the caller-provided arrays with one flag (0/1) per detection, per
+// transition and per division. Detections are enumerated timestep by
+// timestep, transitions and divisions in the order they were added to the
+// graph. The array sizes must match the ct_graph_get_number_of_* counts,
+// otherwise nothing is written and -1 is returned (0 on success).
+int ct_tracker_get_primals(ct_tracker* t, int* detections, size_t detections_size, int* transitions, size_t transitions_size, int* divisions, size_t divisions_size);
+
+// Same as ct_tracker_get_primals, but for the best primal found so far by
+// ct_tracker_run. Can be called from another thread while the tracker is
+// running. Also reports the bounds belonging to the snapshot. Returns the
+// number of iterations at which the lower bound was published, -1 if no
+// feasible primal has been found yet or -2 (without writing) if the array
+// sizes do not match the graph.
+int ct_tracker_get_snapshot(ct_tracker* t, int* detections, size_t detections_size, int* transitions, size_t transitions_size, int* divisions, size_t divisions_size, double* lower_bound, double* upper_bound);
+
+// Writes the current primal solution in the `tracking.sol` format. The id
+// arrays map the enumeration order of ct_tracker_get_primals to the unique
+// ids of the model file (negative ids are skipped). Returns 0 on success and
+// -1 if writing fails or the array sizes do not match the graph.
+int ct_tracker_write_solution(ct_tracker* t, const char* filename, const int* detection_ids, size_t detection_ids_size, const int* appearance_ids, size_t appearance_ids_size, const int* disappearance_ids, size_t disappearance_ids_size, const int* transition_ids, size_t transition_ids_size, const int* division_ids, size_t division_ids_size);
+
+// The (reparametrized) costs of all factors are stored in one flat array of
+// doubles owned by the tracker. The pointer stays valid until the tracker is
+// destroyed, so the costs can be read and modified in place (e.g. for warm
+// starts). Modifications are picked up by the next ct_tracker_run,
+// ct_tracker_resolve, ct_tracker_lower_bound or single step.
+double* ct_tracker_get_costs(ct_tracker* t);
+size_t ct_tracker_get_number_of_costs(ct_tracker* t);
+
+// Bytes currently allocated from the arenas of the tracker (graph structure
+// and costs).
+size_t ct_tracker_get_memory_usage(ct_tracker* t);
+
+// Describes which slice of the flat cost array belongs to which factor. For
+// every detection (enumerated timestep by timestep) five offsets are written:
+// detection cost, begin/end of incoming costs and begin/end of outgoing costs.
+// The last incoming (outgoing) cost is the appearance (disappearance) cost.
+// For every conflict two offsets are written: begin/end of its costs, where
+// the last cost belongs to the "all detections off" state. Both functions
+// return 0 on success and -1 (without writing) if `layout_size` is wrong.
+int ct_tracker_get_detection_layout(ct_tracker* t, long long* layout, size_t layout_size);
+int ct_tracker_get_conflict_layout(ct_tracker* t, long long* layout, size_t layout_size);
+
 //
 // detection API
 //
@@ -6,9 +6,15 @@
 #include <ct/allocator.hpp>
 #include <ct/debug.hpp>
 #include <ct/fixed_vector.hpp>
+#include <ct/array_view.hpp>
 #include <ct/signal_handler.hpp>
+#include <ct/hardware_counters.hpp>
+#include <ct/instrumentation.hpp>
+#include <ct/trace.hpp>
 #include <ct/consistency.hpp>
+#include <ct/simd.hpp>
 #include <ct/misc.hpp>
+#include <ct/thread_pool.hpp>
 
 #include <ct/detection_factor.hpp>
 #include <ct/conflict_factor.hpp>
@@ -17,8 +23,11 @@
 #include <ct/transition_messages.hpp>
 
 #include <ct/graph.hpp>
+#include <ct/solution.hpp>
+#include <ct/checkpoint.hpp>
 #include <ct/conflict_subsolver.hpp>
 #include <ct/tracker.hpp>
+#include <ct/residency.hpp>
 
 #endif
 
@@ -3,6 +3,14 @@
 
 namespace ct {
 
+//
+// Arena for all graph and cost allocations. By default the memory is
+// anonymous (`malloc`). If a directory is given, the block is a shared
+// mapping of an unlinked temporary file in this directory instead. In this
+// case the kernel can write pages back to disk, so the model does not have
+// to fit into RAM, and `advise` can be used to prefetch or evict ranges.
+//
+
 class memory_block {
 public:
   static constexpr size_t size_mib = size_t(1) * 1024 * 1024;
@@ -10,70 +18,176 @@ public:
   static constexpr size_t size_gib = size_mib * 1024;
   static constexpr size_t size_1024gib = size_gib * 1024;
 
+  // The backing file is grown in steps of this size.
+  static constexpr size_t file_growth = size_mib * 64;
+
+  enum class residency { will_need, dont_need };
+
   memory_block()
+  : memory_block(std::string())
+  { }
+
+  explicit memory_block(const std::string& directory)
   : memory_(nullptr)
   , size_(size_1024gib)
   , current_(nullptr)
   , finalized_(false)
+  , fd_(-1)
+  , file_size_(0)
+  , capacity_(0)
   {
+    if (!directory.empty()) {
+      std::string path = directory + "/libct-XXXXXX";
+      fd_ = mkstemp(path.data());
+      if (fd_ < 0)
+        throw std::system_error(errno, std::generic_category(), "cannot create " + path);
+      unlink(path.c_str());
+    }
+
     while (memory_ == nullptr && size_ >= size_512mib) {
-      void* result = std::malloc(size_);
-      if (result == static_cast<void*>(0))
+      void* result = fd_ < 0
+        ? std::malloc(size_)
+        : mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd_, 0);
+      if (result == static_cast<void*>(0) || result == MAP_FAILED)
         size_ -= size_512mib;
       else
         memory_ = static_cast<char*>(result);
     }
 
 #ifndef NDEBUG
-      std::cout << "[mem] ctor: size=" << size_ << "B (" << (1.0f * size_ / size_gib) << "GiB) -> memory_=" << static_cast<void*>(memory_) << std::endl;
+      std::cout << "[mem] ctor: size=" << size_ << "B (" << (1.0f * size_ / size_gib) << "GiB) -> memory_=" << static_cast<void*>(memory_) << (fd_ < 0 ? "" : " (file-backed)") << std::endl;
 #endif
 
-    if (memory_ == nullptr)
+    if (memory_ == nullptr) {
+      if (fd_ >= 0)
+        close(fd_);
       throw std::bad_alloc();
+    }
 
     current_ = memory_;
+    capacity_ = size_;
   }
 
   ~memory_block()
   {
     if (memory_ != nullptr) {
-      std::free(memory_);
+      if (fd_ < 0) {
+        std::free(memory_);
+      } else {
+        munmap(memory_, size_);
+        close(fd_);
+      }
     }
   }
 
+  memory_block(const memory_block&) = delete;
+  memory_block& operator=(const memory_block&) = delete;
+
   char* allocate(size_t s)
   {
     assert(!finalized_);
     if (current_ + s >= memory_ + size_)
       throw std::bad_alloc();
 
+    if (fd_ >= 0 && current_ + s > memory_ + file_size_)
+      resize_file(((current_ + s - memory_) / file_growth + 1) * file_growth);
+
     char* result = current_;
     current_ += s;
     return result;
   }
 
+  // Discards all allocations, so that the block can be reused for another
+  // model without probing for address space again. A finalized anonymous
+  // block is grown back to its original capacity (which is a cheap remap for
+  // huge allocations), a file-backed block truncates its file.
+  void reset()
+  {
+    if (fd_ < 0) {
+      if (size_ != capacity_) {
+        void* result = std::realloc(memory_, capacity_);
+        if (result == static_cast<void*>(0))
+          throw std::bad_alloc();
+        memory_ = static_cast<char*>(result);
+        size_ = capacity_;
+      }
+    } else {
+      resize_file(0);
+    }
+
+    current_ = memory_;
+    finalized_ = false;
+  }
+
   bool is_finalized() const { return finalized_; }
+  bool is_file_backed() const { return fd_ >= 0; }
+
+  // Start of the block and number of bytes handed out so far.
+  char* data() const { return memory_; }
+  size_t used() const { return current_ - memory_; }
+  bool contains(const void* ptr) const { return ptr >= memory_ && ptr < current_; }
+
+  // Hints the kernel that the range [begin, end) is needed soon (it is read
+  // ahead asynchronously) or not needed anymore (it is dropped from the
+  // address space, modified pages are kept in the file). Only file-backed
+  // blocks are affected, as dropping anonymous memory would lose data.
+  void advise(const char* begin, const char* end, residency r) const
+  {
+    if (fd_ < 0)
+      return;
+
+    const auto page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    auto first = reinterpret_cast<std::uintptr_t>(begin);
+    auto last = reinterpret_cast<std::uintptr_t>(end);
+    if (r == residency::will_need) {
+      first = first / page * page;
+      last = (last + page - 1) / page * page;
+    } else {
+      // We only drop pages that are completely contained in the range, so
+      // that neighboring data stays resident.
+      first = (first + page - 1) / page * page;
+      last = last / page * page;
+    }
+
+    if (first < last)
+      madvise(reinterpret_cast<void*>(first), last - first, r == residency::will_need ? MADV_WILLNEED : MADV_DONTNEED);
+  }
 
   void finalize()
   {
     assert(!finalized_);
     auto current_size = current_ - memory_;
-    void* result = std::realloc(memory_, current_size);
-    if (result == static_cast<void*>(0))
-      throw std::bad_alloc();
-    assert(result == memory_);
-    size_ = current_size;
+    if (fd_ < 0) {
+      void* result = std::realloc(memory_, current_size);
+      if (result == static_cast<void*>(0))
+        throw std::bad_alloc();
+      assert(result == memory_);
+      size_ = current_size;
+    } else {
+      // The mapping keeps its size, only the file is shrunk.
+      resize_file(current_size);
+    }
 #ifndef NDEBUG
-      std::cout << "[mem] finalize: size=" << size_ << " (" << (1.0f * size_ / size_mib) << " MiB)" << std::endl;
+      std::cout << "[mem] finalize: size=" << current_size << " (" << (1.0f * current_size / size_mib) << " MiB)" << std::endl;
 #endif
     finalized_ = true;
   }
 
 protected:
+  void resize_file(size_t size)
+  {
+    if (ftruncate(fd_, size) != 0)
+      throw std::bad_alloc();
+    file_size_ = size;
+  }
+
   char* memory_;
   size_t size_;
   char* current_;
   bool finalized_;
+  int fd_;
+  size_t file_size_;
+  size_t capacity_;
 };
 
 template<typename T>
@@ -100,6 +214,12 @@ public:
 
   void deallocate(T* ptr, size_t n = 1) { }
 
+  template<typename U>
+  bool operator==(const block_allocator<U>& other) const { return block_ == other.block_; }
+
+  template<typename U>
+  bool operator!=(const block_allocator<U>& other) const { return !(*this == other); }
+
 protected:
   memory_block* block_;
 
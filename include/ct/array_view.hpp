@@ -0,0 +1,50 @@
+#ifndef LIBCT_ARRAY_VIEW_HPP
+#define LIBCT_ARRAY_VIEW_HPP
+
+namespace ct {
+
+//
+// Non-owning view onto a contiguous range of elements. It offers the subset
+// of the `fixed_vector` interface that the factors need, so that several
+// logical arrays can share one allocation.
+//
+
+template<typename T>
+class array_view {
+public:
+  using value_type = T;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  array_view()
+  : begin_(nullptr)
+  , end_(nullptr)
+  { }
+
+  array_view(T* begin, size_t size)
+  : begin_(begin)
+  , end_(begin + size)
+  { }
+
+  T* begin() const { return begin_; }
+  T* end() const { return end_; }
+  const T* cbegin() const { return begin_; }
+  const T* cend() const { return end_; }
+  T* data() const { return begin_; }
+
+  size_t size() const { return end_ - begin_; }
+
+  T& operator[](size_t idx) const { assert(idx < size()); return begin_[idx]; }
+  T& front() const { assert(size() > 0); return *begin_; }
+  T& back() const { assert(size() > 0); return *(end_ - 1); }
+
+protected:
+  T* begin_;
+  T* end_;
+};
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
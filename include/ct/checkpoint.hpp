@@ -0,0 +1,274 @@
+#ifndef LIBCT_CHECKPOINT_HPP
+#define LIBCT_CHECKPOINT_HPP
+
+namespace ct {
+
+//
+// File handling of the binary formats below. `DERIVED` implements `write`
+// and `read` for streams.
+//
+
+template<typename DERIVED>
+struct binary_file {
+  // Writes to a temporary file first, so that a crash during writing never
+  // destroys the previous file.
+  bool write_file(const std::string& filename) const
+  {
+    const std::string tmp_filename = filename + ".tmp";
+    {
+      std::ofstream out(tmp_filename, std::ios::binary);
+      if (!static_cast<const DERIVED*>(this)->write(out))
+        return false;
+      out.close();
+      if (out.fail())
+        return false;
+    }
+    return std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+  }
+
+  bool read_file(const std::string& filename)
+  {
+    std::ifstream in(filename, std::ios::binary);
+    return static_cast<DERIVED*>(this)->read(in);
+  }
+
+protected:
+  // Number of bytes between the current position and the end of `in`. The
+  // sizes in a header are checked against it before anything is allocated,
+  // so a corrupt file can not request huge allocations.
+  static uint64_t remaining_bytes(std::istream& in)
+  {
+    const auto position = in.tellg();
+    if (position < 0)
+      return 0;
+    in.seekg(0, std::ios::end);
+    const auto end = in.tellg();
+    in.seekg(position);
+    return end > position ? static_cast<uint64_t>(end - position) : 0;
+  }
+
+  template<typename T>
+  static void write_array(std::ostream& out, const T* data, size_t size)
+  {
+    out.write(reinterpret_cast<const char*>(data), sizeof(T) * size);
+  }
+
+  template<typename T>
+  static bool read_array(std::istream& in, T* data, size_t size)
+  {
+    in.read(reinterpret_cast<char*>(data), sizeof(T) * size);
+    return bool(in);
+  }
+};
+
+
+//
+// Complete solver state of a tracker, i.e. everything that is not part of
+// the graph structure: The (reparametrized) costs of all factors, the
+// primals, the best upper bound and the iteration counter.
+//
+// The binary file format (native byte order) is:
+//
+//   char[8]   magic "LIBCTSTA"
+//   uint32    version
+//   uint32    reserved (zero)
+//   uint64    number of costs
+//   uint64    number of detections
+//   uint64    number of conflicts
+//   int64     iterations
+//   double    constant, lower bound, upper bound
+//   double[]  costs of all detections, then of all conflicts (enumerated
+//             timestep by timestep, see `ct_tracker_get_detection_layout`)
+//   uint32[]  incoming and outgoing primal of every detection
+//   uint32[]  primal of every conflict
+//
+// The graph structure itself is not stored. It must be rebuilt identically
+// before a state is loaded.
+//
+
+struct solver_state : binary_file<solver_state> {
+  static constexpr char magic[8] = {'L', 'I', 'B', 'C', 'T', 'S', 'T', 'A'};
+  static constexpr uint32_t version = 1;
+
+  int64_t iterations;
+  cost constant;
+  cost lower_bound;
+  cost upper_bound;
+  std::vector<cost> costs;
+  std::vector<uint32_t> detection_primals;
+  std::vector<uint32_t> conflict_primals;
+
+  size_t number_of_detections() const { return detection_primals.size() / 2; }
+  size_t number_of_conflicts() const { return conflict_primals.size(); }
+
+  bool write(std::ostream& out) const
+  {
+    const uint32_t header[2] = { version, 0 };
+    const uint64_t sizes[3] = { costs.size(), number_of_detections(), number_of_conflicts() };
+    const cost bounds[3] = { constant, lower_bound, upper_bound };
+
+    out.write(magic, sizeof(magic));
+    write_array(out, header, 2);
+    write_array(out, sizes, 3);
+    write_array(out, &iterations, 1);
+    write_array(out, bounds, 3);
+    write_array(out, costs.data(), costs.size());
+    write_array(out, detection_primals.data(), detection_primals.size());
+    write_array(out, conflict_primals.data(), conflict_primals.size());
+    return out.good();
+  }
+
+  bool read(std::istream& in)
+  {
+    char m[sizeof(magic)];
+    uint32_t header[2];
+    uint64_t sizes[3];
+    cost bounds[3];
+
+    in.read(m, sizeof(m));
+    if (!in || !std::equal(m, m + sizeof(m), magic))
+      return false;
+
+    if (!read_array(in, header, 2) || header[0] != version)
+      return false;
+
+    if (!read_array(in, sizes, 3) || !read_array(in, &iterations, 1) || !read_array(in, bounds, 3))
+      return false;
+
+    const uint64_t remaining = remaining_bytes(in);
+    if (sizes[0] > remaining / sizeof(cost) ||
+        sizes[1] > remaining / (2 * sizeof(uint32_t)) ||
+        sizes[2] > remaining / sizeof(uint32_t) ||
+        sizes[0] * sizeof(cost) + (2 * sizes[1] + sizes[2]) * sizeof(uint32_t) > remaining)
+      return false;
+
+    constant = bounds[0];
+    lower_bound = bounds[1];
+    upper_bound = bounds[2];
+    costs.resize(sizes[0]);
+    detection_primals.resize(2 * sizes[1]);
+    conflict_primals.resize(sizes[2]);
+
+    return read_array(in, costs.data(), costs.size()) &&
+           read_array(in, detection_primals.data(), detection_primals.size()) &&
+           read_array(in, conflict_primals.data(), conflict_primals.size());
+  }
+};
+
+
+//
+// Transferable reparametrization, i.e. how the costs of the transitions,
+// divisions and conflicts are currently distributed among the factors.
+// Unlike `solver_state` it does not contain the costs themselves, so it can
+// be applied to a related model (e.g. the same data with other cost
+// parameters, or a neighboring well with a similar structure) as a warm
+// start, see `tracker::apply_reparametrization`.
+//
+// The state of an edge is the deviation of the share of each attached
+// detection from the even split (cost / 2 for transitions, cost / 3 for
+// divisions). These deviations sum up to zero, so only the outgoing share
+// of a transition and the outgoing and first incoming share of a division
+// are stored. The state of a conflict is the cost of each of its slots
+// (zero initially), which is compensated by the detection cost of the
+// linked detection.
+//
+// Edges are identified by (timestep, detection, outgoing slot) of their
+// source, conflict slots by (timestep, conflict, slot). The binary file
+// format (native byte order) is:
+//
+//   char[8]   magic "LIBCTREP"
+//   uint32    version
+//   uint32    reserved (zero)
+//   uint64    number of transitions, divisions and conflict slots
+//   uint32[]  keys of all transitions (3 per transition)
+//   double[]  deviations of all transitions (1 per transition)
+//   uint32[]  keys of all divisions (3 per division)
+//   double[]  deviations of all divisions (2 per division)
+//   uint32[]  keys of all conflict slots (3 per slot)
+//   double[]  costs of all conflict slots
+//
+
+struct reparametrization : binary_file<reparametrization> {
+  static constexpr char magic[8] = {'L', 'I', 'B', 'C', 'T', 'R', 'E', 'P'};
+  static constexpr uint32_t version = 1;
+
+  std::vector<uint32_t> transition_keys;
+  std::vector<cost> transition_deviations;
+  std::vector<uint32_t> division_keys;
+  std::vector<cost> division_deviations;
+  std::vector<uint32_t> conflict_keys;
+  std::vector<cost> conflict_costs;
+
+  size_t number_of_transitions() const { return transition_deviations.size(); }
+  size_t number_of_divisions() const { return division_deviations.size() / 2; }
+  size_t number_of_conflict_slots() const { return conflict_costs.size(); }
+
+  void clear()
+  {
+    transition_keys.clear();
+    transition_deviations.clear();
+    division_keys.clear();
+    division_deviations.clear();
+    conflict_keys.clear();
+    conflict_costs.clear();
+  }
+
+  bool write(std::ostream& out) const
+  {
+    const uint32_t header[2] = { version, 0 };
+    const uint64_t sizes[3] = { number_of_transitions(), number_of_divisions(), number_of_conflict_slots() };
+
+    out.write(magic, sizeof(magic));
+    write_array(out, header, 2);
+    write_array(out, sizes, 3);
+    write_array(out, transition_keys.data(), transition_keys.size());
+    write_array(out, transition_deviations.data(), transition_deviations.size());
+    write_array(out, division_keys.data(), division_keys.size());
+    write_array(out, division_deviations.data(), division_deviations.size());
+    write_array(out, conflict_keys.data(), conflict_keys.size());
+    write_array(out, conflict_costs.data(), conflict_costs.size());
+    return out.good();
+  }
+
+  bool read(std::istream& in)
+  {
+    char m[sizeof(magic)];
+    uint32_t header[2];
+    uint64_t sizes[3];
+
+    in.read(m, sizeof(m));
+    if (!in || !std::equal(m, m + sizeof(m), magic))
+      return false;
+
+    if (!read_array(in, header, 2) || header[0] != version || !read_array(in, sizes, 3))
+      return false;
+
+    // Bytes per transition, division and conflict slot.
+    constexpr uint64_t key_bytes = 3 * sizeof(uint32_t);
+    constexpr uint64_t bytes[3] = { key_bytes + sizeof(cost), key_bytes + 2 * sizeof(cost), key_bytes + sizeof(cost) };
+    const uint64_t remaining = remaining_bytes(in);
+    if (sizes[0] > remaining / bytes[0] || sizes[1] > remaining / bytes[1] || sizes[2] > remaining / bytes[2] ||
+        sizes[0] * bytes[0] + sizes[1] * bytes[1] + sizes[2] * bytes[2] > remaining)
+      return false;
+
+    transition_keys.resize(3 * sizes[0]);
+    transition_deviations.resize(sizes[0]);
+    division_keys.resize(3 * sizes[1]);
+    division_deviations.resize(2 * sizes[1]);
+    conflict_keys.resize(3 * sizes[2]);
+    conflict_costs.resize(sizes[2]);
+
+    return read_array(in, transition_keys.data(), transition_keys.size()) &&
+           read_array(in, transition_deviations.data(), transition_deviations.size()) &&
+           read_array(in, division_keys.data(), division_keys.size()) &&
+           read_array(in, division_deviations.data(), division_deviations.size()) &&
+           read_array(in, conflict_keys.data(), conflict_keys.size()) &&
+           read_array(in, conflict_costs.data(), conflict_costs.size());
+  }
+};
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
@@ -63,6 +63,8 @@ public:
 #endif
 
   auto size() const { return costs_.size(); }
+  const cost* data() const { return costs_.data(); }
+  cost* data() { return costs_.data(); }
 
   bool is_prepared() const { return true; }
 
@@ -72,7 +74,7 @@ public:
   cost lower_bound() const
   {
     assert(costs_.size() > 0);
-    return *std::min_element(costs_.begin(), costs_.end());
+    return simd::min_value(costs_.data(), costs_.data() + costs_.size());
   }
 
   void repam(const index idx, const cost msg)
@@ -28,6 +28,14 @@ public:
     outgoing_ = undecided;
   }
 
+  // Forgets the outgoing decision of a detection that is switched on, but
+  // keeps the detection state and the incoming decision.
+  void reset_outgoing()
+  {
+    if (outgoing_ != off)
+      outgoing_ = undecided;
+  }
+
   void set_incoming(const index incoming)
   {
     assert(incoming_ == undecided || incoming_ == incoming);
@@ -98,17 +106,37 @@ protected:
 };
 
 
+//
+// All costs of a detection factor live in a single allocation with the
+// following flat layout:
+//
+//   [detection | incoming_0 ... incoming_n, appearance | outgoing_0 ... outgoing_m, disappearance]
+//
+// The layout is stable, so that the costs of all factors can be exposed as
+// one contiguous array (see `ct_tracker_get_detection_layout`).
+//
+// The minima of the incoming and outgoing side are cached, as they are read
+// far more often than the costs change (e.g. by every message of every
+// conflict round). The `repam_*` methods update the cache incrementally.
+// Only if the current minimum increases, it is marked as stale and the side
+// is scanned again on the next access. Code that writes to the costs through
+// `data()` must call `invalidate_cached_minima` afterwards.
+//
+
 template<typename ALLOCATOR = std::allocator<cost>>
 class detection_factor {
 public:
   using allocator_type = ALLOCATOR;
   static constexpr cost initial_cost = std::numeric_limits<cost>::signaling_NaN();
+  static constexpr cost stale_minimum = std::numeric_limits<cost>::quiet_NaN();
 
   detection_factor(index number_of_incoming, index number_of_outgoing, const ALLOCATOR& allocator = ALLOCATOR())
-  : detection_(initial_cost)
-  , incoming_(number_of_incoming + 1, initial_cost, allocator)
-  , outgoing_(number_of_outgoing + 1, initial_cost, allocator)
+  : costs_(number_of_incoming + number_of_outgoing + 3, initial_cost, allocator)
+  , incoming_(costs_.data() + 1, number_of_incoming + 1)
+  , outgoing_(costs_.data() + number_of_incoming + 2, number_of_outgoing + 1)
   , primal_(incoming_.size(), outgoing_.size())
+  , min_incoming_(stale_minimum)
+  , min_outgoing_(stale_minimum)
 #ifndef NDEBUG
   , timestep_(-1)
   , index_(-1)
@@ -138,7 +166,7 @@ public:
   // cost getters
   //
 
-  cost detection() const { return detection_; }
+  cost detection() const { return costs_[0]; }
   cost appearance() const { return incoming_.back(); }
   cost disappearance() const { return outgoing_.back(); }
   cost incoming(const index idx) const { assert_incoming(idx); return incoming_[idx]; }
@@ -148,17 +176,49 @@ public:
   // methods to initialize costs
   //
 
-  void set_detection_cost(cost on) { detection_ = on; }
-  void set_appearance_cost(cost c) { incoming_.back() = c; }
-  void set_disappearance_cost(cost c) { outgoing_.back() = c; }
-  void set_incoming_cost(index idx, cost c) { assert_incoming(idx); incoming_[idx] = c; }
-  void set_outgoing_cost(index idx, cost c) { assert_outgoing(idx); outgoing_[idx] = c; }
+  // Enlarges the outgoing side (e.g. when a new frame is appended in online
+  // mode). The costs are moved into a new allocation, existing outgoing
+  // slots and the disappearance keep their (reparametrized) costs, the new
+  // slots have to be initialized via `set_outgoing_cost`. The outgoing primal
+  // is reset as the disappearance slot changes its index.
+  void resize_outgoing(index number_of_outgoing, const ALLOCATOR& allocator)
+  {
+    const index number_of_incoming = incoming_.size() - 1;
+    assert(number_of_outgoing + 1 >= outgoing_.size());
+
+    decltype(costs_) costs(number_of_incoming + number_of_outgoing + 3, initial_cost, allocator);
+    std::copy(costs_.cbegin(), costs_.cend() - 1, costs.begin());
+    costs.back() = disappearance();
+
+    costs_ = std::move(costs);
+    incoming_ = array_view<cost>(costs_.data() + 1, number_of_incoming + 1);
+    outgoing_ = array_view<cost>(costs_.data() + number_of_incoming + 2, number_of_outgoing + 1);
+    min_outgoing_ = stale_minimum;
+
+    const auto old_primal = primal_;
+    primal_ = detection_primal(incoming_.size(), outgoing_.size());
+    if (old_primal.is_detection_off())
+      primal_.set_detection_off();
+    else if (old_primal.is_incoming_set())
+      primal_.set_incoming(old_primal.incoming());
+  }
+
+  void set_detection_cost(cost on) { costs_[0] = on; }
+  void set_appearance_cost(cost c) { incoming_.back() = c; min_incoming_ = stale_minimum; }
+  void set_disappearance_cost(cost c) { outgoing_.back() = c; min_outgoing_ = stale_minimum; }
+  void set_incoming_cost(index idx, cost c) { assert_incoming(idx); incoming_[idx] = c; min_incoming_ = stale_minimum; }
+  void set_outgoing_cost(index idx, cost c) { assert_outgoing(idx); outgoing_[idx] = c; min_outgoing_ = stale_minimum; }
+
+  void invalidate_cached_minima() const
+  {
+    min_incoming_ = stale_minimum;
+    min_outgoing_ = stale_minimum;
+  }
 
   bool is_prepared() const
   {
-    bool result = !std::isnan(detection_);
-    for (const auto& x : incoming_) { result = result && !std::isnan(x); }
-    for (const auto& x : outgoing_) { result = result && !std::isnan(x); }
+    bool result = true;
+    for (const auto& x : costs_) { result = result && !std::isnan(x); }
     return result;
   }
 
@@ -169,18 +229,24 @@ public:
   cost min_incoming() const
   {
     assert(incoming_.size() > 0);
-    return *std::min_element(incoming_.begin(), incoming_.end());
+    if (std::isnan(min_incoming_))
+      min_incoming_ = simd::min_value(incoming_.begin(), incoming_.end());
+    assert_cached_minimum(min_incoming_, incoming_);
+    return min_incoming_;
   }
 
   cost min_outgoing() const
   {
     assert(outgoing_.size() > 0);
-    return *std::min_element(outgoing_.begin(), outgoing_.end());
+    if (std::isnan(min_outgoing_))
+      min_outgoing_ = simd::min_value(outgoing_.begin(), outgoing_.end());
+    assert_cached_minimum(min_outgoing_, outgoing_);
+    return min_outgoing_;
   }
 
   cost min_detection() const
   {
-    return detection_ + min_incoming() + min_outgoing();
+    return detection() + min_incoming() + min_outgoing();
   }
 
   cost lower_bound() const
@@ -188,9 +254,11 @@ public:
     return std::min(min_detection(), 0.0);
   }
 
-  void repam_detection(const cost msg) { detection_ += msg; }
-  void repam_incoming(const index idx, const cost msg) { assert_incoming(idx); incoming_[idx] += msg; }
-  void repam_outgoing(const index idx, const cost msg) { assert_outgoing(idx); outgoing_[idx] += msg; }
+  void repam_detection(const cost msg) { costs_[0] += msg; }
+  void repam_incoming(const index idx, const cost msg) { assert_incoming(idx); repam(incoming_[idx], min_incoming_, msg); }
+  void repam_outgoing(const index idx, const cost msg) { assert_outgoing(idx); repam(outgoing_[idx], min_outgoing_, msg); }
+  void repam_appearance(const cost msg) { repam(incoming_.back(), min_incoming_, msg); }
+  void repam_disappearance(const cost msg) { repam(outgoing_.back(), min_outgoing_, msg); }
 
   void reset_primal() { primal_.reset(); }
 
@@ -200,7 +268,7 @@ public:
     if (primal_.is_detection_off())
       result = 0.0;
     else if (primal_.is_incoming_set() && primal_.is_outgoing_set())
-      result = incoming_[primal_.incoming()] + detection_ + outgoing_[primal_.outgoing()];
+      result = incoming_[primal_.incoming()] + detection() + outgoing_[primal_.outgoing()];
     else
       result = std::numeric_limits<cost>::infinity();
     return result;
@@ -222,7 +290,7 @@ public:
     auto this_side = from_left ? min_element(incoming_.cbegin(), incoming_.cend(), active.cbegin(), active.cend())
                                : min_element(outgoing_.cbegin(), outgoing_.cend(), active.cbegin(), active.cend());
 
-    if (*this_side + detection_ + opposite_side <= 0 || primal_.is_detection_on()) {
+    if (*this_side + detection() + opposite_side <= 0 || primal_.is_detection_on()) {
       if constexpr (from_left)
         primal_.set_incoming(this_side - incoming_.cbegin());
       else
@@ -245,6 +313,11 @@ public:
     }
   }
 
+  // Raw access to the flat cost layout described above.
+  const cost* data() const { return costs_.data(); }
+  cost* data() { return costs_.data(); }
+  size_t size() const { return costs_.size(); }
+
   void fix_primal()
   {
     assert(primal_.is_incoming_set() || primal_.is_outgoing_set());
@@ -258,10 +331,32 @@ public:
 protected:
   void assert_incoming(const index idx) const { assert(idx >= 0 && idx < incoming_.size() - 1); }
   void assert_outgoing(const index idx) const { assert(idx >= 0 && idx < outgoing_.size() - 1); }
-  cost detection_;
-  fixed_vector_alloc_gen<cost, ALLOCATOR> incoming_;
-  fixed_vector_alloc_gen<cost, ALLOCATOR> outgoing_;
+
+  void assert_cached_minimum(const cost minimum, const array_view<cost>& side) const
+  {
+#ifndef NDEBUG
+    if (!std::isnan(minimum))
+      assert(minimum == *std::min_element(side.begin(), side.end()));
+#endif
+  }
+
+  // A stale minimum is NaN, so both comparisons below are false for it.
+  static void repam(cost& value, cost& minimum, const cost msg)
+  {
+    const cost old = value;
+    value += msg;
+    if (value < minimum)
+      minimum = value;
+    else if (old == minimum && value > old)
+      minimum = stale_minimum;
+  }
+
+  fixed_vector_alloc_gen<cost, ALLOCATOR> costs_;
+  array_view<cost> incoming_;
+  array_view<cost> outgoing_;
   detection_primal primal_;
+  mutable cost min_incoming_;
+  mutable cost min_outgoing_;
 
 #ifndef NDEBUG
   index timestep_, index_;
@@ -14,6 +14,7 @@ public:
   using base::cbegin;
   using base::cend;
   using base::const_iterator;
+  using base::data;
   using base::end;
   using base::front;
   using base::iterator;
@@ -95,6 +95,21 @@ struct transition_edge {
 };
 
 
+//
+// Transitions and divisions are numbered in the order in which they are added
+// to the graph. The id is the position in `graph::transitions()` or
+// `graph::divisions()` respectively, where we remember the originating
+// outgoing slot. This allows bulk extraction of primals without storing the
+// id inside of the (hot) edge structs.
+//
+
+struct outgoing_slot {
+  index timestep;
+  index detection;
+  index slot;
+};
+
+
 template<typename NODE_TYPE>
 struct conflict_edge {
   using node_type = NODE_TYPE;
@@ -125,13 +140,21 @@ struct detection_node {
   fixed_vector_alloc_gen<transition_edge<node_type>, ALLOCATOR> outgoing;
   fixed_vector_alloc_gen<conflict_edge<conflict_type>, ALLOCATOR> conflicts;
 
-  detection_node(index number_of_incoming, index number_of_outgoing, index number_of_conflicts, const allocator_type& allocator)
-  : factor(number_of_incoming, number_of_outgoing, allocator)
+  detection_node(index number_of_incoming, index number_of_outgoing, index number_of_conflicts, const allocator_type& allocator, const allocator_type& cost_allocator)
+  : factor(number_of_incoming, number_of_outgoing, cost_allocator)
   , incoming(number_of_incoming, allocator)
   , outgoing(number_of_outgoing, allocator)
   , conflicts(number_of_conflicts, allocator)
   { }
 
+  void resize_outgoing(index number_of_outgoing, const allocator_type& allocator, const allocator_type& cost_allocator)
+  {
+    decltype(outgoing) new_outgoing(number_of_outgoing, allocator);
+    std::copy(outgoing.begin(), outgoing.end(), new_outgoing.begin());
+    outgoing = std::move(new_outgoing);
+    factor.resize_outgoing(number_of_outgoing, cost_allocator);
+  }
+
   template<bool to_right>
   auto& transitions() const
   {
@@ -188,8 +211,8 @@ struct conflict_node {
   mutable conflict_type factor;
   fixed_vector_alloc_gen<conflict_edge<detection_type>, ALLOCATOR> detections;
 
-  conflict_node(index number_of_detections, const allocator_type& allocator)
-  : factor(number_of_detections, allocator)
+  conflict_node(index number_of_detections, const allocator_type& allocator, const allocator_type& cost_allocator)
+  : factor(number_of_detections, cost_allocator)
   , detections(number_of_detections, allocator)
   { }
 
@@ -215,6 +238,52 @@ struct conflict_node {
 };
 
 
+//
+// The detections of a timestep ordered by their number of transitions in one
+// direction (and whether any of them is a division). Consecutive nodes with
+// the same key form a group, so that the message passing can select a kernel
+// that is specialized for the degree once per group instead of once per node
+// (see `transition_messages::send_messages`). Within a group the original
+// order is kept.
+//
+
+template<typename NODE_TYPE>
+struct degree_groups {
+  struct group {
+    index degree;
+    bool division;
+    index begin, end;
+  };
+
+  template<bool to_right>
+  void build(const std::vector<NODE_TYPE*>& detections)
+  {
+    auto key = [](const NODE_TYPE* node) {
+      const auto& edges = node->template transitions<to_right>();
+      const bool division = to_right && std::any_of(edges.begin(), edges.end(),
+        [](const auto& edge) { return edge.node2 != nullptr; });
+      return std::make_tuple(static_cast<index>(edges.size()), division);
+    };
+
+    nodes.assign(detections.begin(), detections.end());
+    std::stable_sort(nodes.begin(), nodes.end(), [&](const auto* a, const auto* b) {
+      return key(a) < key(b);
+    });
+
+    groups.clear();
+    for (index i = 0; i < nodes.size(); ++i) {
+      const auto [degree, division] = key(nodes[i]);
+      if (groups.empty() || groups.back().degree != degree || groups.back().division != division)
+        groups.push_back({degree, division, i, i});
+      ++groups.back().end;
+    }
+  }
+
+  std::vector<const NODE_TYPE*> nodes;
+  std::vector<group> groups;
+};
+
+
 template<typename ALLOCATOR>
 struct timestep {
   using allocator_type = ALLOCATOR;
@@ -223,6 +292,58 @@ struct timestep {
 
   std::vector<detection_type*> detections;
   std::vector<conflict_type*> conflicts;
+
+  // The classification below (degree groups and features) is computed on
+  // first use after the structure of the timestep has changed (see
+  // `graph::invalidate_classification`).
+  template<bool to_right>
+  const auto& groups_by_degree() const
+  {
+    classify();
+    return to_right ? outgoing_groups : incoming_groups;
+  }
+
+  // True if a transition into or out of this timestep is a division.
+  bool has_divisions() const
+  {
+    classify();
+    return divisions;
+  }
+
+  // Bytes touched by a sweep over this timestep (nodes, edges and costs).
+  size_t memory_footprint() const
+  {
+    size_t result = 0;
+    for (const auto* node : detections)
+      result += sizeof(*node) + node->factor.size() * sizeof(cost) +
+                (node->incoming.size() + node->outgoing.size()) * sizeof(node->incoming[0]) +
+                node->conflicts.size() * sizeof(node->conflicts[0]);
+    for (const auto* node : conflicts)
+      result += sizeof(*node) + node->factor.size() * sizeof(cost) +
+                node->detections.size() * sizeof(node->detections[0]);
+    return result;
+  }
+
+  void classify() const
+  {
+    if (classified)
+      return;
+
+    incoming_groups.template build<false>(detections);
+    outgoing_groups.template build<true>(detections);
+
+    auto is_division = [](const auto& edge) { return edge.node2 != nullptr; };
+    divisions = std::any_of(detections.begin(), detections.end(), [&](const auto* node) {
+      return std::any_of(node->incoming.begin(), node->incoming.end(), is_division) ||
+             std::any_of(node->outgoing.begin(), node->outgoing.end(), is_division);
+    });
+
+    classified = true;
+  }
+
+  mutable degree_groups<detection_type> incoming_groups, outgoing_groups;
+  mutable bool divisions = false;
+  mutable bool classified = false;
 };
 
 
@@ -236,11 +357,32 @@ public:
   using conflict_type = typename conflict_node_type::conflict_type;
   using timestep_type = timestep<ALLOCATOR>;
 
+  // The costs of all factors are allocated via `cost_allocator` and the
+  // remaining structure via `allocator`. Using two different arenas keeps the
+  // costs in one flat array (see `detection_factor`).
   graph(const ALLOCATOR& allocator = ALLOCATOR())
+  : graph(allocator, allocator)
+  { }
+
+  graph(const ALLOCATOR& allocator, const ALLOCATOR& cost_allocator)
   : allocator_(allocator)
+  , cost_allocator_(cost_allocator)
   { }
 
+  // Forgets all nodes (e.g. before the underlying memory is reset). The
+  // allocators are kept. Like everywhere else, the nodes are not destroyed,
+  // so this is only meant for arena allocators.
+  void clear()
+  {
+    factor_counter_ = factor_counter();
+    timesteps_.clear();
+    transitions_.clear();
+    divisions_.clear();
+  }
+
   const auto& timesteps() const { return timesteps_; }
+  const auto& transitions() const { return transitions_; }
+  const auto& divisions() const { return divisions_; }
 
   detection_node_type* add_detection(index timestep, index detection, index number_of_incoming, index number_of_outgoing, index number_of_conflicts)
   {
@@ -251,6 +393,7 @@ public:
     if (timestep >= timesteps_.size())
       timesteps_.resize(timestep + 1);
     auto& detections = timesteps_[timestep].detections;
+    invalidate_classification(timestep);
 
     if (detection >= detections.size())
       detections.resize(detection + 1);
@@ -258,7 +401,7 @@ public:
 
     typename std::allocator_traits<allocator_type>::template rebind_alloc<detection_node_type> a(allocator_);
     node = a.allocate();
-    new (node) detection_node_type(number_of_incoming, number_of_outgoing, number_of_conflicts, allocator_);
+    new (node) detection_node_type(number_of_incoming, number_of_outgoing, number_of_conflicts, allocator_, cost_allocator_);
 #ifndef NDEBUG
     node->factor.set_debug_info(timestep, detection);
 #endif
@@ -278,7 +421,7 @@ public:
 
     typename std::allocator_traits<allocator_type>::template rebind_alloc<conflict_node_type> a(allocator_);
     node = a.allocate();
-    new (node) conflict_node_type(number_of_detections, allocator_); // FIXME: Dtor is never called.
+    new (node) conflict_node_type(number_of_detections, allocator_, cost_allocator_); // FIXME: Dtor is never called.
 #ifndef NDEBUG
     node->factor.set_debug_info(timestep, conflict);
 #endif
@@ -286,6 +429,19 @@ public:
     return node;
   }
 
+  // Online mode: Enlarges the outgoing side of an existing detection, so that
+  // it can be linked to a timestep that is appended later on. Existing
+  // slots keep their costs and edges, the new ones have to be initialized
+  // like for a fresh detection. The old storage is not reclaimed.
+  void resize_outgoing(index timestep, index detection, index number_of_outgoing)
+  {
+    auto* node = timesteps_[timestep].detections[detection];
+    assert(number_of_outgoing >= node->outgoing.size());
+    assert(number_of_outgoing <= max_number_of_detection_edges);
+    node->resize_outgoing(number_of_outgoing, allocator_, cost_allocator_);
+    invalidate_classification(timestep);
+  }
+
   void add_transition(index timestep_from, index detection_from, index slot_from, index detection_to, index slot_to)
   {
     auto* from_node = timesteps_[timestep_from].detections[detection_from];
@@ -300,6 +456,8 @@ public:
     assert(to_node->incoming[slot_to].node2 == nullptr);
     to_node->incoming[slot_to].node1 = from_node;
     to_node->incoming[slot_to].slot1 = slot_from;
+
+    transitions_.push_back({timestep_from, detection_from, slot_from});
   }
 
   void add_division(index timestep_from, index detection_from, index slot_from, index detection_to_1, index slot_to_1, index detection_to_2, index slot_to_2)
@@ -328,6 +486,24 @@ public:
     to_node_2->incoming[slot_to_2].slot1 = slot_from;
     to_node_2->incoming[slot_to_2].node2 = to_node_1;
     to_node_2->incoming[slot_to_2].slot2 = slot_to_1;
+
+    divisions_.push_back({timestep_from, detection_from, slot_from});
+    invalidate_classification(timestep_from);
+    invalidate_classification(timestep_from + 1);
+  }
+
+  // Sets the cost of the transition or division leaving the given outgoing
+  // slot (must be added before). The cost is split evenly among all attached
+  // detections, see `tracker::initialize` for a better distribution.
+  void set_transition_cost(index timestep, index detection, index slot, cost c)
+  {
+    const auto* node = timesteps_[timestep].detections[detection];
+    const auto& edge = node->outgoing[slot];
+    const cost share = edge.is_division() ? c / 3 : c / 2;
+    node->factor.set_outgoing_cost(slot, share);
+    edge.node1->factor.set_incoming_cost(edge.slot1, share);
+    if (edge.is_division())
+      edge.node2->factor.set_incoming_cost(edge.slot2, share);
   }
 
   void add_conflict_link(index timestep, index conflict, index conflict_slot, index detection, index detection_slot)
@@ -349,12 +525,17 @@ public:
     return timesteps_[timestep].detections[detection];
   }
 
+  const detection_node_type* detection(index timestep, index detection) const
+  {
+    return timesteps_[timestep].detections[detection];
+  }
+
   conflict_node_type* conflict(index timestep, index conflict)
   {
     return timesteps_[timestep].conflicts[conflict];
   }
 
-  size_t number_of_detections()
+  size_t number_of_detections() const
   {
     return std::accumulate(
       timesteps_.cbegin(), timesteps_.cend(), 0,
@@ -363,7 +544,7 @@ public:
       });
   }
 
-  size_t number_of_conflicts()
+  size_t number_of_conflicts() const
   {
     return std::accumulate(
       timesteps_.cbegin(), timesteps_.cend(), 0,
@@ -372,6 +553,16 @@ public:
       });
   }
 
+  size_t number_of_transitions() const { return transitions_.size(); }
+  size_t number_of_divisions() const { return divisions_.size(); }
+
+  // Needs to be called if the number of transitions of a detection changes
+  // or if one of its transitions becomes a division.
+  void invalidate_classification(index timestep)
+  {
+    timesteps_[timestep].classified = false;
+  }
+
   void check_structure() const
   {
     for (auto& timestep : timesteps_) {
@@ -385,8 +576,11 @@ public:
 
 protected:
   allocator_type allocator_;
+  allocator_type cost_allocator_;
   factor_counter factor_counter_;
   std::vector<timestep_type> timesteps_;
+  std::vector<outgoing_slot> transitions_;
+  std::vector<outgoing_slot> divisions_;
 };
 
 }
@@ -0,0 +1,120 @@
+#ifndef LIBCT_HARDWARE_COUNTERS_HPP
+#define LIBCT_HARDWARE_COUNTERS_HPP
+
+namespace ct {
+
+//
+// Hardware performance counters of the calling thread via `perf_event_open`
+// (Linux only). The events are opened as one group, so they are always
+// scheduled together and their counts refer to the same time interval.
+// Only user space is counted, which works with the default setting of
+// `kernel.perf_event_paranoid`. Events that are not supported by the CPU
+// (or the hypervisor) read as zero. If even the cycle counter cannot be
+// opened, `open` fails and all events read as zero.
+//
+
+enum class hardware_event { cycles, instructions, llc_misses, branch_misses };
+
+constexpr int number_of_hardware_events = static_cast<int>(hardware_event::branch_misses) + 1;
+
+inline const char* hardware_event_name(hardware_event e)
+{
+  static const char* names[number_of_hardware_events] = {
+    "cycles", "instructions", "llc_misses", "branch_misses" };
+  return names[static_cast<int>(e)];
+}
+
+using hardware_counts = std::array<uint64_t, number_of_hardware_events>;
+
+class hardware_counters {
+public:
+  hardware_counters()
+  : number_of_open_(0)
+  {
+    fds_.fill(-1);
+  }
+
+  ~hardware_counters() { close(); }
+
+  hardware_counters(const hardware_counters&) = delete;
+  hardware_counters& operator=(const hardware_counters&) = delete;
+
+  bool open()
+  {
+#ifdef __linux__
+    if (is_open())
+      return true;
+
+    static constexpr uint64_t configs[number_of_hardware_events] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+    for (int i = 0; i < number_of_hardware_events; ++i) {
+      perf_event_attr attr = {};
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.disabled = i == 0;
+
+      const int leader = fds_[0];
+      const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+      if (fd < 0 && i == 0)
+        return false;
+
+      fds_[i] = fd;
+      slots_[i] = fd < 0 ? -1 : number_of_open_++;
+    }
+
+    ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void close()
+  {
+    for (auto& fd : fds_) {
+      if (fd >= 0)
+        ::close(fd);
+      fd = -1;
+    }
+    number_of_open_ = 0;
+  }
+
+  bool is_open() const { return fds_[0] >= 0; }
+
+  // Current values of the free-running counters, only differences between
+  // two reads are meaningful.
+  hardware_counts read() const
+  {
+    hardware_counts result = {};
+    if (!is_open())
+      return result;
+
+    std::array<uint64_t, number_of_hardware_events + 1> buffer; // count followed by the values
+    const auto bytes = ::read(fds_[0], buffer.data(), (number_of_open_ + 1) * sizeof(uint64_t));
+    if (bytes < static_cast<ssize_t>((number_of_open_ + 1) * sizeof(uint64_t)))
+      return result;
+
+    for (int i = 0; i < number_of_hardware_events; ++i)
+      if (slots_[i] >= 0)
+        result[i] = buffer[slots_[i] + 1];
+    return result;
+  }
+
+protected:
+  std::array<int, number_of_hardware_events> fds_;
+  std::array<int, number_of_hardware_events> slots_;
+  int number_of_open_;
+};
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
@@ -0,0 +1,295 @@
+#ifndef LIBCT_INSTRUMENTATION_HPP
+#define LIBCT_INSTRUMENTATION_HPP
+
+namespace ct {
+
+//
+// Per-phase timing and counters of `tracker::run`.
+//
+// The instrumentation is always compiled in but disabled by default. While
+// disabled, every probe is a single well-predicted branch. When enabled,
+// the wall time of each phase and a couple of counters are accumulated
+// per batch and per timestep (phases outside of `single_step` are only
+// attributed to the batch). `write_json` dumps everything at the end of a
+// run.
+//
+// Optionally, the hardware counters (cycles, instructions, LLC misses and
+// branch misses) are sampled at the boundaries of the phases as well. Each
+// sample is a system call, so this adds a few microseconds per probe.
+//
+
+enum class phase {
+  conflict_messages,    // conflict rounds at the start of `single_step`
+  transition_messages,  // transition messages at the end of `single_step`
+  subsolver,            // conflict subsolver (Gurobi) during rounding
+  rounding_sort,        // ordering of the detections for rounding
+  rounding,             // rounding work except for the two phases above
+  evaluate_primal,
+  lower_bound,
+  primal_copy,          // publishing and restoring the best primals
+};
+
+enum class counter {
+  transition_messages,  // detections that sent their transition messages
+  conflict_messages,    // conflict factors that sent messages (per direction)
+  subsolver_calls,
+  nodes_rounded,
+  candidates_evaluated, // primals evaluated as upper bound candidates
+};
+
+constexpr int number_of_phases = static_cast<int>(phase::primal_copy) + 1;
+constexpr int number_of_counters = static_cast<int>(counter::candidates_evaluated) + 1;
+
+inline const char* phase_name(phase p)
+{
+  static const char* names[number_of_phases] = {
+    "conflict_messages", "transition_messages", "subsolver", "rounding_sort",
+    "rounding", "evaluate_primal", "lower_bound", "primal_copy" };
+  return names[static_cast<int>(p)];
+}
+
+inline const char* counter_name(counter c)
+{
+  static const char* names[number_of_counters] = {
+    "transition_messages", "conflict_messages", "subsolver_calls",
+    "nodes_rounded", "candidates_evaluated" };
+  return names[static_cast<int>(c)];
+}
+
+
+struct phase_statistics {
+  std::array<double, number_of_phases> seconds = {};
+  std::array<uint64_t, number_of_counters> counts = {};
+  std::array<hardware_counts, number_of_phases> hardware = {};
+
+  double& operator[](phase p) { return seconds[static_cast<int>(p)]; }
+  double operator[](phase p) const { return seconds[static_cast<int>(p)]; }
+  uint64_t& operator[](counter c) { return counts[static_cast<int>(c)]; }
+  uint64_t operator[](counter c) const { return counts[static_cast<int>(c)]; }
+
+  phase_statistics& operator+=(const phase_statistics& other)
+  {
+    for (int i = 0; i < number_of_phases; ++i)
+      seconds[i] += other.seconds[i];
+    for (int i = 0; i < number_of_counters; ++i)
+      counts[i] += other.counts[i];
+    for (int i = 0; i < number_of_phases; ++i)
+      for (int j = 0; j < number_of_hardware_events; ++j)
+        hardware[i][j] += other.hardware[i][j];
+    return *this;
+  }
+};
+
+struct batch_statistics : phase_statistics {
+  int iterations = 0; // total number of iterations at the end of the batch
+};
+
+
+class instrumentation {
+public:
+  using clock_type = std::chrono::steady_clock;
+  using seconds_type = std::chrono::duration<double>;
+  static constexpr index no_timestep = std::numeric_limits<index>::max();
+
+  // Measures the lifetime of the object as `phase`. Scopes can be nested,
+  // the time of an inner scope is not counted for the outer one, so the
+  // phases never overlap.
+  class scope {
+  public:
+    scope(instrumentation& parent, phase p)
+    : parent_(parent.enabled_ ? &parent : nullptr)
+    , phase_(p)
+    , nested_(0)
+    , nested_hardware_()
+    {
+      if (parent_ != nullptr) {
+        outer_ = parent_->active_;
+        parent_->active_ = this;
+        hardware_begin_ = parent_->hardware_.read();
+        begin_ = clock_type::now();
+      }
+    }
+
+    ~scope()
+    {
+      if (parent_ != nullptr) {
+        const double elapsed = seconds_type(clock_type::now() - begin_).count();
+        const auto hardware_end = parent_->hardware_.read();
+
+        hardware_counts hardware;
+        for (int i = 0; i < number_of_hardware_events; ++i)
+          hardware[i] = hardware_end[i] - hardware_begin_[i];
+
+        parent_->add(phase_, elapsed - nested_, hardware, nested_hardware_);
+        if (outer_ != nullptr) {
+          outer_->nested_ += elapsed;
+          for (int i = 0; i < number_of_hardware_events; ++i)
+            outer_->nested_hardware_[i] += hardware[i];
+        }
+        parent_->active_ = outer_;
+      }
+    }
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+  protected:
+    instrumentation* parent_;
+    scope* outer_;
+    phase phase_;
+    double nested_;
+    hardware_counts nested_hardware_;
+    hardware_counts hardware_begin_;
+    clock_type::time_point begin_;
+  };
+
+  instrumentation()
+  : enabled_(false)
+  , timestep_(no_timestep)
+  , active_(nullptr)
+  { }
+
+  void set_enabled(bool enabled) { enabled_ = enabled; }
+  bool enabled() const { return enabled_; }
+
+  // Returns false if the hardware counters are not available (e.g. not on
+  // Linux or not permitted), then their statistics stay zero.
+  bool set_hardware_counters(bool enabled)
+  {
+    if (!enabled) {
+      hardware_.close();
+      return true;
+    }
+    return hardware_.open();
+  }
+
+  bool hardware_counters_enabled() const { return hardware_.is_open(); }
+
+  // Discards the statistics of the previous run.
+  void begin_run(index number_of_timesteps)
+  {
+    batches_.clear();
+    current_ = batch_statistics();
+    timesteps_.assign(enabled_ ? number_of_timesteps : 0, phase_statistics());
+    timestep_ = no_timestep;
+  }
+
+  void end_batch(int iterations)
+  {
+    if (!enabled_)
+      return;
+    current_.iterations = iterations;
+    batches_.push_back(current_);
+    current_ = batch_statistics();
+  }
+
+  // Subsequent measurements are attributed to this timestep as well.
+  void set_timestep(index t)
+  {
+    if (enabled_)
+      timestep_ = t;
+  }
+
+  scope measure(phase p) { return scope(*this, p); }
+
+  void count(counter c, uint64_t n = 1)
+  {
+    if (!enabled_)
+      return;
+    current_[c] += n;
+    if (timestep_ < timesteps_.size())
+      timesteps_[timestep_][c] += n;
+  }
+
+  const auto& batches() const { return batches_; }
+  const auto& timesteps() const { return timesteps_; }
+
+  // Sum over all batches (including a batch that was not finished).
+  phase_statistics total() const
+  {
+    phase_statistics result = current_;
+    for (const auto& b : batches_)
+      result += b;
+    return result;
+  }
+
+  void write_json(std::ostream& out) const
+  {
+    auto write_statistics = [&](const phase_statistics& s) {
+      out << "{\"seconds\": {";
+      for (int i = 0; i < number_of_phases; ++i)
+        out << (i > 0 ? ", " : "") << "\"" << phase_name(static_cast<phase>(i)) << "\": " << s.seconds[i];
+      out << "}, \"counts\": {";
+      for (int i = 0; i < number_of_counters; ++i)
+        out << (i > 0 ? ", " : "") << "\"" << counter_name(static_cast<counter>(i)) << "\": " << s.counts[i];
+      out << "}";
+      if (hardware_.is_open()) {
+        out << ", \"hardware\": {";
+        for (int i = 0; i < number_of_phases; ++i) {
+          out << (i > 0 ? ", " : "") << "\"" << phase_name(static_cast<phase>(i)) << "\": {";
+          for (int j = 0; j < number_of_hardware_events; ++j)
+            out << (j > 0 ? ", " : "") << "\"" << hardware_event_name(static_cast<hardware_event>(j)) << "\": " << s.hardware[i][j];
+          out << "}";
+        }
+        out << "}";
+      }
+    };
+
+    const auto precision = out.precision(std::numeric_limits<double>::max_digits10);
+    out << "{\n  \"total\": ";
+    write_statistics(total());
+    out << "},\n  \"batches\": [";
+    for (size_t i = 0; i < batches_.size(); ++i) {
+      out << (i > 0 ? ",\n    " : "\n    ");
+      write_statistics(batches_[i]);
+      out << ", \"iterations\": " << batches_[i].iterations << "}";
+    }
+    out << "\n  ],\n  \"timesteps\": [";
+    for (size_t i = 0; i < timesteps_.size(); ++i) {
+      out << (i > 0 ? ",\n    " : "\n    ");
+      write_statistics(timesteps_[i]);
+      out << "}";
+    }
+    out << "\n  ]\n}\n";
+    out.precision(precision);
+  }
+
+  bool write_json(const std::string& filename) const
+  {
+    std::ofstream out(filename);
+    write_json(out);
+    return static_cast<bool>(out);
+  }
+
+protected:
+  void add(phase p, double seconds, const hardware_counts& hardware, const hardware_counts& nested_hardware)
+  {
+    current_[p] += seconds;
+    if (timestep_ < timesteps_.size())
+      timesteps_[timestep_][p] += seconds;
+
+    if (hardware_.is_open()) {
+      const int i = static_cast<int>(p);
+      for (int j = 0; j < number_of_hardware_events; ++j) {
+        const auto exclusive = hardware[j] - nested_hardware[j];
+        current_.hardware[i][j] += exclusive;
+        if (timestep_ < timesteps_.size())
+          timesteps_[timestep_].hardware[i][j] += exclusive;
+      }
+    }
+  }
+
+  bool enabled_;
+  index timestep_;
+  scope* active_;
+  ct::hardware_counters hardware_;
+  batch_statistics current_;
+  std::vector<batch_statistics> batches_;
+  std::vector<phase_statistics> timesteps_;
+};
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
@@ -3,6 +3,20 @@
 
 namespace ct {
 
+// Size of the unified L2 or L3 cache in bytes, or zero if the system does
+// not report it.
+inline size_t cache_size(int level)
+{
+  long size = 0;
+#if defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+  if (level == 2)
+    size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  else if (level == 3)
+    size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+  return size > 0 ? size : 0;
+}
+
 template<typename FORWARD_ITERATOR_DATA, typename FORWARD_ITERATOR_BOOL>
 auto min_element(FORWARD_ITERATOR_DATA data_begin, FORWARD_ITERATOR_DATA data_end,
                  FORWARD_ITERATOR_BOOL active_begin, FORWARD_ITERATOR_BOOL active_end)
@@ -43,12 +57,16 @@ auto least_two_values(FORWARD_ITERATOR begin, FORWARD_ITERATOR end)
   using value_type = std::decay_t<decltype(*begin)>;
   constexpr auto inf = std::numeric_limits<value_type>::infinity();
 
-  auto [first, second] = least_two_elements(begin, end);
+  if constexpr (std::is_convertible_v<FORWARD_ITERATOR, const cost*>) {
+    return simd::least_two_values(begin, end);
+  } else {
+    auto [first, second] = least_two_elements(begin, end);
 
-  const auto first_val = first != end ? *first : inf;
-  const auto second_val = second != end ? *second : inf;
+    const auto first_val = first != end ? *first : inf;
+    const auto second_val = second != end ? *second : inf;
 
-  return std::make_tuple(first_val, second_val);
+    return std::make_tuple(first_val, second_val);
+  }
 }
 
 }
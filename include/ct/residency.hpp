@@ -0,0 +1,126 @@
+#ifndef LIBCT_RESIDENCY_HPP
+#define LIBCT_RESIDENCY_HPP
+
+namespace ct {
+
+//
+// Keeps only a window of timesteps resident while the tracker sweeps over a
+// graph that lives in file-backed memory blocks (see `memory_block`). It is
+// installed as sweep observer of the tracker (`tracker::set_sweep_observer`)
+// and is informed before a timestep is processed. The `lookahead` upcoming
+// timesteps (in sweep direction) are prefetched asynchronously by the kernel,
+// timesteps that lie more than one step behind are evicted (message passing
+// touches the direct neighbors of the current timestep).
+//
+// The address ranges of all timesteps are recomputed whenever one of the
+// blocks grew (e.g. a timestep was appended in online mode).
+//
+
+template<typename GRAPH_TYPE>
+class residency_manager {
+public:
+  residency_manager(const GRAPH_TYPE& graph, std::vector<const memory_block*> blocks, index lookahead = 2)
+  : graph_(graph)
+  , blocks_(std::move(blocks))
+  , lookahead_(lookahead)
+  { }
+
+  // Forces a recomputation of all ranges (e.g. after the blocks were reset).
+  void invalidate()
+  {
+    ranges_.clear();
+    used_.clear();
+  }
+
+  void operator()(const index timestep, const bool forward)
+  {
+    update_ranges();
+    const index number_of_timesteps = ranges_.size();
+    assert(timestep < number_of_timesteps);
+
+    if (forward) {
+      if (timestep + lookahead_ < number_of_timesteps)
+        advise(timestep + lookahead_, memory_block::residency::will_need);
+      if (timestep >= 2)
+        advise(timestep - 2, memory_block::residency::dont_need);
+    } else {
+      if (timestep >= lookahead_)
+        advise(timestep - lookahead_, memory_block::residency::will_need);
+      if (timestep + 2 < number_of_timesteps)
+        advise(timestep + 2, memory_block::residency::dont_need);
+    }
+  }
+
+protected:
+  struct range {
+    const char* begin;
+    const char* end;
+  };
+
+  void advise(const index timestep, const memory_block::residency r) const
+  {
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+      const auto& rng = ranges_[timestep][i];
+      if (rng.begin < rng.end)
+        blocks_[i]->advise(rng.begin, rng.end, r);
+    }
+  }
+
+  void update_ranges()
+  {
+    bool changed = ranges_.size() != graph_.timesteps().size() || used_.size() != blocks_.size();
+    used_.resize(blocks_.size());
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+      changed = changed || used_[i] != blocks_[i]->used();
+      used_[i] = blocks_[i]->used();
+    }
+    if (!changed)
+      return;
+
+    ranges_.assign(graph_.timesteps().size(), std::vector<range>(blocks_.size(), range{nullptr, nullptr}));
+    for (index t = 0; t < graph_.timesteps().size(); ++t) {
+      auto& ranges = ranges_[t];
+      auto add = [&](const auto* ptr, size_t count) {
+        if (count == 0)
+          return;
+        const auto* begin = reinterpret_cast<const char*>(ptr);
+        const auto* end = reinterpret_cast<const char*>(ptr + count);
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+          if (blocks_[i]->contains(begin)) {
+            auto& r = ranges[i];
+            r.begin = r.begin == nullptr ? begin : std::min(r.begin, begin);
+            r.end = r.end == nullptr ? end : std::max(r.end, end);
+            return;
+          }
+        }
+      };
+
+      const auto& timestep = graph_.timesteps()[t];
+      for (const auto* node : timestep.detections) {
+        add(node, 1);
+        add(node->incoming.data(), node->incoming.size());
+        add(node->outgoing.data(), node->outgoing.size());
+        add(node->conflicts.data(), node->conflicts.size());
+        add(node->factor.data(), node->factor.size());
+      }
+
+      for (const auto* node : timestep.conflicts) {
+        add(node, 1);
+        add(node->detections.data(), node->detections.size());
+        add(node->factor.data(), node->factor.size());
+      }
+    }
+  }
+
+  const GRAPH_TYPE& graph_;
+  std::vector<const memory_block*> blocks_;
+  index lookahead_;
+  std::vector<std::vector<range>> ranges_;
+  std::vector<size_t> used_;
+};
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
@@ -1,36 +1,60 @@
 #ifndef LIBCT_SIGNAL_HANDLER_HPP
 #define LIBCT_SIGNAL_HANDLER_HPP
 
-extern "C" {
-  static volatile sig_atomic_t ct_signaled;
-
-  void ct_signal_handler(int sig)
-  {
-    ct_signaled = 1;
-  }
-}
-
 namespace ct {
 
+//
+// Scoped SIGINT handler. Several instances can be alive at the same time (e.g.
+// one per concurrently running tracker), the process-wide handler is installed
+// by the first one and the previous handler is restored by the last one. A
+// caught signal is visible to all instances and is re-raised once the last
+// instance goes away.
+//
+
 class signal_handler {
 public:
-  signal_handler()
+  signal_handler(bool enabled = true)
+  : enabled_(enabled)
   {
-    ct_signaled = 0;
-    old_handler_ = std::signal(SIGINT, ct_signal_handler);
+    if (!enabled_)
+      return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (users_++ == 0) {
+      signaled_ = 0;
+      old_handler_ = std::signal(SIGINT, handler);
+    }
   }
 
   ~signal_handler()
   {
-    std::signal(SIGINT, old_handler_);
-    if (signaled())
-      std::raise(SIGINT);
+    if (!enabled_)
+      return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--users_ == 0) {
+      std::signal(SIGINT, old_handler_);
+      if (signaled_ != 0) {
+        signaled_ = 0;
+        std::raise(SIGINT);
+      }
+    }
   }
 
-  bool signaled() const { return ct_signaled != 0; };
+  signal_handler(const signal_handler&) = delete;
+  signal_handler& operator=(const signal_handler&) = delete;
+
+  bool signaled() const { return enabled_ && signaled_ != 0; };
 
 protected:
-  void(*old_handler_)(int);
+  static void handler(int sig) { signaled_ = 1; }
+
+  bool enabled_;
+
+  static inline volatile std::sig_atomic_t signaled_ = 0;
+  static inline std::mutex mutex_;
+  static inline int users_ = 0;
+  static inline void(*old_handler_)(int) = nullptr;
 };
 
 }
@@ -0,0 +1,219 @@
+#ifndef LIBCT_SIMD_HPP
+#define LIBCT_SIMD_HPP
+
+namespace ct {
+
+//
+// Vectorized reductions over the (short) cost arrays of the factors.
+//
+// The library is compiled for the baseline instruction set, so the AVX2 and
+// AVX-512 kernels are compiled via function attributes and the fastest one
+// supported by the CPU is selected at runtime. The remainder of an array is
+// loaded with a mask and filled up with +inf, so the storage does not need
+// any padding and the flat cost layout stays unchanged. Minima are exact,
+// hence all kernels return the same values as the scalar fallback.
+//
+
+namespace simd {
+
+enum class level { scalar, avx2, avx512 };
+
+namespace scalar {
+
+inline cost min_value(const cost* begin, const cost* end)
+{
+  cost result = std::numeric_limits<cost>::infinity();
+  for (auto it = begin; it != end; ++it)
+    result = *it < result ? *it : result;
+  return result;
+}
+
+inline std::tuple<cost, cost> least_two_values(const cost* begin, const cost* end)
+{
+  cost first = std::numeric_limits<cost>::infinity();
+  cost second = std::numeric_limits<cost>::infinity();
+  for (auto it = begin; it != end; ++it) {
+    if (*it < first) {
+      second = first;
+      first = *it;
+    } else if (*it < second) {
+      second = *it;
+    }
+  }
+  return std::make_tuple(first, second);
+}
+
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LIBCT_SIMD_X86
+
+namespace avx2 {
+
+// Loads the first `n` < 4 elements, the other lanes are +inf.
+__attribute__((target("avx2")))
+inline __m256d load_tail(const cost* p, size_t n)
+{
+  alignas(32) static constexpr int64_t masks[8] = { -1, -1, -1, -1, 0, 0, 0, 0 };
+  const __m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(masks + 4 - n));
+  return _mm256_blendv_pd(_mm256_set1_pd(std::numeric_limits<cost>::infinity()),
+                          _mm256_maskload_pd(p, mask), _mm256_castsi256_pd(mask));
+}
+
+__attribute__((target("avx2")))
+inline cost reduce_min(__m256d m)
+{
+  __m128d x = _mm_min_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+  x = _mm_min_sd(x, _mm_unpackhi_pd(x, x));
+  return _mm_cvtsd_f64(x);
+}
+
+// Least two values of the lanes of `m`, where the second one is bounded by
+// the lanes of `bound` (e.g. the per-lane second minima).
+__attribute__((target("avx2")))
+inline std::tuple<cost, cost> reduce_least_two(__m256d m, __m256d bound)
+{
+  const __m128d lo = _mm256_castpd256_pd128(m), hi = _mm256_extractf128_pd(m, 1);
+  const __m128d l = _mm_min_pd(lo, hi), h = _mm_max_pd(lo, hi);
+  const __m128d l_swapped = _mm_unpackhi_pd(l, l), h_swapped = _mm_unpackhi_pd(h, h);
+  const __m128d second = _mm_min_sd(_mm_max_sd(l, l_swapped), _mm_min_sd(h, h_swapped));
+  return std::make_tuple(_mm_cvtsd_f64(_mm_min_sd(l, l_swapped)),
+                         std::min(_mm_cvtsd_f64(second), reduce_min(bound)));
+}
+
+__attribute__((target("avx2")))
+inline cost min_value(const cost* begin, const cost* end)
+{
+  const size_t n = end - begin;
+  __m256d m = _mm256_set1_pd(std::numeric_limits<cost>::infinity());
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    m = _mm256_min_pd(m, _mm256_loadu_pd(begin + i));
+  if (i < n)
+    m = _mm256_min_pd(m, load_tail(begin + i, n - i));
+  return reduce_min(m);
+}
+
+// Every lane keeps its own minimum and second minimum.
+__attribute__((target("avx2")))
+inline std::tuple<cost, cost> least_two_values(const cost* begin, const cost* end)
+{
+  const size_t n = end - begin;
+  __m256d m1 = _mm256_set1_pd(std::numeric_limits<cost>::infinity());
+  __m256d m2 = m1;
+  for (size_t i = 0; i < n; i += 4) {
+    const __m256d x = i + 4 <= n ? _mm256_loadu_pd(begin + i) : load_tail(begin + i, n - i);
+    m2 = _mm256_min_pd(m2, _mm256_max_pd(m1, x));
+    m1 = _mm256_min_pd(m1, x);
+  }
+  return reduce_least_two(m1, m2);
+}
+
+}
+
+// The masked variants of the AVX-512 intrinsics are used throughout, as the
+// unmasked ones trigger false uninitialized warnings in some GCC versions.
+namespace avx512 {
+
+constexpr __mmask8 all = 0xff;
+
+__attribute__((target("avx512f")))
+inline __m512d load(const cost* p, size_t n)
+{
+  const __m512d inf = _mm512_set1_pd(std::numeric_limits<cost>::infinity());
+  return _mm512_mask_loadu_pd(inf, n >= 8 ? all : (1u << n) - 1, p);
+}
+
+__attribute__((target("avx512f")))
+inline __m256d half(__m512d x, bool upper)
+{
+  const __m256d zero = _mm256_setzero_pd();
+  return upper ? _mm512_mask_extractf64x4_pd(zero, all, x, 1) : _mm512_mask_extractf64x4_pd(zero, all, x, 0);
+}
+
+__attribute__((target("avx512f")))
+inline cost min_value(const cost* begin, const cost* end)
+{
+  const size_t n = end - begin;
+  __m512d m = _mm512_set1_pd(std::numeric_limits<cost>::infinity());
+  for (size_t i = 0; i < n; i += 8)
+    m = _mm512_mask_min_pd(m, all, m, load(begin + i, n - i));
+  return avx2::reduce_min(_mm256_min_pd(half(m, false), half(m, true)));
+}
+
+__attribute__((target("avx512f")))
+inline std::tuple<cost, cost> least_two_values(const cost* begin, const cost* end)
+{
+  const size_t n = end - begin;
+  __m512d m1 = _mm512_set1_pd(std::numeric_limits<cost>::infinity());
+  __m512d m2 = m1;
+  for (size_t i = 0; i < n; i += 8) {
+    const __m512d x = load(begin + i, n - i);
+    m2 = _mm512_mask_min_pd(m2, all, m2, _mm512_mask_max_pd(m1, all, m1, x));
+    m1 = _mm512_mask_min_pd(m1, all, m1, x);
+  }
+
+  const __m256d lo = half(m1, false), hi = half(m1, true);
+  const __m256d bound = _mm256_min_pd(_mm256_max_pd(lo, hi), _mm256_min_pd(half(m2, false), half(m2, true)));
+  return avx2::reduce_least_two(_mm256_min_pd(lo, hi), bound);
+}
+
+}
+#endif
+
+inline level supported_level()
+{
+#ifdef LIBCT_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return level::avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return level::avx2;
+#endif
+  return level::scalar;
+}
+
+inline level active_level = supported_level();
+
+// Restricts the kernels to a lower level (e.g. for benchmarks). Levels that
+// are not supported by the CPU are ignored.
+inline void set_level(level l) { active_level = std::min(l, supported_level()); }
+inline level get_level() { return active_level; }
+
+// Very short arrays are handled by the scalar code, which is cheaper than
+// the lane reduction for them. For the typical degrees (up to ~20) the
+// AVX-512 kernels are not faster than the AVX2 ones (only one or two
+// iterations before the reduction), so they are only used for long arrays.
+constexpr size_t avx512_threshold = 32;
+
+inline cost min_value(const cost* begin, const cost* end)
+{
+#ifdef LIBCT_SIMD_X86
+  const size_t n = end - begin;
+  if (active_level == level::avx512 && n >= avx512_threshold)
+    return avx512::min_value(begin, end);
+  if (active_level != level::scalar && n >= 4)
+    return avx2::min_value(begin, end);
+#endif
+  return scalar::min_value(begin, end);
+}
+
+inline std::tuple<cost, cost> least_two_values(const cost* begin, const cost* end)
+{
+#ifdef LIBCT_SIMD_X86
+  const size_t n = end - begin;
+  if (active_level == level::avx512 && n >= avx512_threshold)
+    return avx512::least_two_values(begin, end);
+  if (active_level != level::scalar && n >= 3)
+    return avx2::least_two_values(begin, end);
+#endif
+  return scalar::least_two_values(begin, end);
+}
+
+}
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
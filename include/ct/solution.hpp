@@ -0,0 +1,153 @@
+#ifndef LIBCT_SOLUTION_HPP
+#define LIBCT_SOLUTION_HPP
+
+namespace ct {
+
+//
+// Bulk access to the primal state of a whole graph.
+//
+// Detections are enumerated timestep by timestep (the same order in which
+// they have to be added to the graph), transitions and divisions by their id
+// (see `outgoing_slot`). All output iterators receive exactly one value per
+// element: `1` if it is active and `0` otherwise.
+//
+// The primals are either read from the factors of the graph directly or from
+// a stored copy (e.g. a `primal_snapshot`), see `graph_primals` and
+// `stored_primals` below.
+//
+
+template<typename GRAPH_TYPE>
+class graph_primals {
+public:
+  graph_primals(const GRAPH_TYPE& graph)
+  : graph_(graph)
+  { }
+
+  const detection_primal& operator()(index timestep, index detection) const
+  {
+    return graph_.detection(timestep, detection)->factor.primal();
+  }
+
+protected:
+  const GRAPH_TYPE& graph_;
+};
+
+
+class stored_primals {
+public:
+  template<typename GRAPH_TYPE>
+  stored_primals(const GRAPH_TYPE& graph, const std::vector<detection_primal>& primals)
+  : primals_(primals)
+  {
+    assert(primals_.size() == graph.number_of_detections());
+    offsets_.reserve(graph.timesteps().size());
+    size_t offset = 0;
+    for (const auto& timestep : graph.timesteps()) {
+      offsets_.push_back(offset);
+      offset += timestep.detections.size();
+    }
+  }
+
+  const detection_primal& operator()(index timestep, index detection) const
+  {
+    return primals_[offsets_[timestep] + detection];
+  }
+
+protected:
+  const std::vector<detection_primal>& primals_;
+  std::vector<size_t> offsets_;
+};
+
+
+struct solution {
+
+  template<typename GRAPH_TYPE, typename PRIMALS, typename OUTPUT_ITERATOR>
+  static void extract_detections(const GRAPH_TYPE& graph, const PRIMALS& primals, OUTPUT_ITERATOR out)
+  {
+    const auto& timesteps = graph.timesteps();
+    for (index t = 0; t < timesteps.size(); ++t)
+      for (index d = 0; d < timesteps[t].detections.size(); ++d)
+        *out++ = is_detection_on(primals(t, d)) ? 1 : 0;
+  }
+
+  template<typename GRAPH_TYPE, typename PRIMALS, typename OUTPUT_ITERATOR>
+  static void extract_transitions(const GRAPH_TYPE& graph, const PRIMALS& primals, OUTPUT_ITERATOR out)
+  {
+    for (const auto& s : graph.transitions())
+      *out++ = is_slot_active(primals, s) ? 1 : 0;
+  }
+
+  template<typename GRAPH_TYPE, typename PRIMALS, typename OUTPUT_ITERATOR>
+  static void extract_divisions(const GRAPH_TYPE& graph, const PRIMALS& primals, OUTPUT_ITERATOR out)
+  {
+    for (const auto& s : graph.divisions())
+      *out++ = is_slot_active(primals, s) ? 1 : 0;
+  }
+
+  // Writes the primal solution in the `tracking.sol` text format. The id
+  // arrays map from the enumeration order described above to the unique ids
+  // of the input file. Negative ids are skipped (e.g. for missing appearance
+  // or disappearance variables).
+  template<typename GRAPH_TYPE, typename PRIMALS>
+  static void write(const GRAPH_TYPE& graph, const PRIMALS& primals, std::ostream& out,
+                    const int* detection_ids, const int* appearance_ids, const int* disappearance_ids,
+                    const int* transition_ids, const int* division_ids)
+  {
+    auto write_line = [&out](const char* tag, int id) {
+      if (id >= 0)
+        out << tag << ' ' << id << '\n';
+    };
+
+    size_t i = 0;
+    const auto& timesteps = graph.timesteps();
+    for (index t = 0; t < timesteps.size(); ++t) {
+      for (index d = 0; d < timesteps[t].detections.size(); ++d) {
+        const auto* node = timesteps[t].detections[d];
+        const auto& p = primals(t, d);
+        if (is_detection_on(p)) {
+          if (p.incoming() == node->incoming.size())
+            write_line("APP", appearance_ids[i]);
+          write_line("H", detection_ids[i]);
+          if (p.outgoing() == node->outgoing.size())
+            write_line("DISAPP", disappearance_ids[i]);
+        }
+        ++i;
+      }
+    }
+
+    i = 0;
+    for (const auto& s : graph.transitions()) {
+      if (is_slot_active(primals, s))
+        write_line("MOVE", transition_ids[i]);
+      ++i;
+    }
+
+    i = 0;
+    for (const auto& s : graph.divisions()) {
+      if (is_slot_active(primals, s))
+        write_line("DIV", division_ids[i]);
+      ++i;
+    }
+  }
+
+private:
+
+  static bool is_detection_on(const detection_primal& p)
+  {
+    return p.is_incoming_set() && p.is_outgoing_set() && !p.is_detection_off();
+  }
+
+  template<typename PRIMALS>
+  static bool is_slot_active(const PRIMALS& primals, const outgoing_slot& s)
+  {
+    const auto& p = primals(s.timestep, s.detection);
+    return !p.is_detection_off() && p.is_outgoing_set() && p.outgoing() == s.slot;
+  }
+
+};
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
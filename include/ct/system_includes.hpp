@@ -2,19 +2,47 @@
 #define LIBCT_SYSTEM_INCLUDES_HPP
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <csignal>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <set>
 #include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <tuple>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include <gurobi_c++.h>
 
 #endif
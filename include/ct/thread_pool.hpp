@@ -0,0 +1,116 @@
+#ifndef LIBCT_THREAD_POOL_HPP
+#define LIBCT_THREAD_POOL_HPP
+
+namespace ct {
+
+//
+// Fixed set of worker threads for data-parallel loops. `parallel_for`
+// blocks until all indices are processed, the calling thread takes part in
+// the work. The indices are handed out one by one via an atomic counter,
+// which balances the load as long as the work per index (e.g. a timestep)
+// is large compared to an atomic increment.
+//
+// Only one `parallel_for` may be active at a time.
+//
+
+class thread_pool {
+public:
+  // `threads` includes the calling thread, so `threads - 1` workers are
+  // started.
+  thread_pool(int threads)
+  : generation_(0)
+  , stop_(false)
+  , active_(0)
+  , size_(0)
+  {
+    for (int i = 1; i < threads; ++i)
+      workers_.emplace_back([this]() { work(); });
+  }
+
+  ~thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& w : workers_)
+      w.join();
+  }
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  int size() const { return workers_.size() + 1; }
+
+  template<typename FUNCTOR>
+  void parallel_for(const index size, FUNCTOR f)
+  {
+    if (workers_.empty() || size <= 1) {
+      for (index i = 0; i < size; ++i)
+        f(i);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = [&f](index i) { f(i); };
+      size_ = size;
+      next_ = 0;
+      active_ = workers_.size();
+      ++generation_;
+    }
+    wake_.notify_all();
+
+    process();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return active_ == 0; });
+    task_ = nullptr;
+  }
+
+protected:
+  void process()
+  {
+    for (index i = next_++; i < size_; i = next_++)
+      task_(i);
+  }
+
+  void work()
+  {
+    uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+        if (stop_)
+          return;
+        seen = generation_;
+      }
+
+      process();
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--active_ == 0)
+        done_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  uint64_t generation_;
+  bool stop_;
+  index active_;
+
+  std::function<void(index)> task_;
+  index size_;
+  std::atomic<index> next_;
+};
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
@@ -0,0 +1,239 @@
+#ifndef LIBCT_TRACE_HPP
+#define LIBCT_TRACE_HPP
+
+namespace ct {
+
+//
+// Timeline of the solver phases in the Chrome trace-event format (can be
+// opened with chrome://tracing or https://ui.perfetto.dev).
+//
+// Every thread records into its own ring buffer, so recording needs neither
+// locks nor atomic read-modify-write operations. A buffer is registered
+// once per thread and recorder, only this registration takes a lock. If a
+// buffer overflows, the oldest events are overwritten, i.e. the trace shows
+// the end of a long run. The buffers are only read by `write_json`, which
+// must not run concurrently with recording threads (the tracker writes the
+// trace when `run` returns).
+//
+// While tracing is disabled, a probe costs a single branch.
+//
+
+struct trace_event {
+  const char* name;     // must be a string literal
+  int64_t argument;     // e.g. the timestep or batch, negative if unused
+  uint64_t begin_ns;
+  uint64_t duration_ns;
+};
+
+class trace_buffer {
+public:
+  trace_buffer(size_t capacity, int thread_id)
+  : events_(round_up_to_power_of_two(capacity))
+  , mask_(events_.size() - 1)
+  , head_(0)
+  , thread_id_(thread_id)
+  { }
+
+  // Only called by the owning thread.
+  void push(const trace_event& e)
+  {
+    const auto head = head_.load(std::memory_order_relaxed);
+    events_[head & mask_] = e;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  template<typename FUNCTOR>
+  void for_each(FUNCTOR f) const
+  {
+    const auto head = head_.load(std::memory_order_acquire);
+    const auto first = head > events_.size() ? head - events_.size() : 0;
+    for (auto i = first; i < head; ++i)
+      f(events_[i & mask_]);
+  }
+
+  uint64_t dropped() const
+  {
+    const auto head = head_.load(std::memory_order_acquire);
+    return head > events_.size() ? head - events_.size() : 0;
+  }
+
+  int thread_id() const { return thread_id_; }
+
+  void clear() { head_.store(0, std::memory_order_relaxed); }
+
+protected:
+  static size_t round_up_to_power_of_two(size_t n)
+  {
+    size_t result = 1;
+    while (result < n)
+      result <<= 1;
+    return result;
+  }
+
+  std::vector<trace_event> events_;
+  size_t mask_;
+  std::atomic<uint64_t> head_;
+  int thread_id_;
+};
+
+
+class trace_recorder {
+public:
+  using clock_type = std::chrono::steady_clock;
+  static constexpr size_t default_capacity = size_t(1) << 18;
+
+  // Records the lifetime of the object as one event.
+  class scope {
+  public:
+    scope(trace_recorder& parent, const char* name, int64_t argument)
+    : parent_(parent.enabled_ ? &parent : nullptr)
+    , name_(name)
+    , argument_(argument)
+    {
+      if (parent_ != nullptr)
+        begin_ = clock_type::now();
+    }
+
+    ~scope()
+    {
+      if (parent_ != nullptr)
+        parent_->record(name_, argument_, begin_, clock_type::now());
+    }
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+  protected:
+    trace_recorder* parent_;
+    const char* name_;
+    int64_t argument_;
+    clock_type::time_point begin_;
+  };
+
+  trace_recorder()
+  : enabled_(false)
+  , capacity_(default_capacity)
+  , generation_(next_generation())
+  , origin_(clock_type::now())
+  { }
+
+  trace_recorder(const trace_recorder&) = delete;
+  trace_recorder& operator=(const trace_recorder&) = delete;
+
+  // `capacity` is the number of events per thread (rounded up to a power of
+  // two), it applies to buffers registered after the call.
+  void set_enabled(bool enabled, size_t capacity = default_capacity)
+  {
+    enabled_ = enabled;
+    capacity_ = std::max<size_t>(capacity, 1);
+  }
+
+  bool enabled() const { return enabled_; }
+
+  // Discards all events and drops the buffers. Threads register again on
+  // their next event. Must not run concurrently with recording threads.
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.clear();
+    generation_ = next_generation();
+    origin_ = clock_type::now();
+  }
+
+  scope trace(const char* name, int64_t argument = -1) { return scope(*this, name, argument); }
+
+  void write_json(std::ostream& out) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto precision = out.precision(3);
+    out << std::fixed << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+
+    bool first = true;
+    auto separator = [&]() {
+      out << (first ? "\n" : ",\n");
+      first = false;
+    };
+
+    for (const auto& buffer : buffers_) {
+      separator();
+      out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->thread_id()
+          << ", \"args\": {\"name\": \"thread " << buffer->thread_id()
+          << "\", \"dropped_events\": " << buffer->dropped() << "}}";
+
+      buffer->for_each([&](const trace_event& e) {
+        separator();
+        out << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->thread_id()
+            << ", \"ts\": " << e.begin_ns / 1e3 << ", \"dur\": " << e.duration_ns / 1e3;
+        if (e.argument >= 0)
+          out << ", \"args\": {\"index\": " << e.argument << "}";
+        out << "}";
+      });
+    }
+
+    out << "\n]}\n";
+    out.unsetf(std::ios_base::floatfield);
+    out.precision(precision);
+  }
+
+  bool write_json(const std::string& filename) const
+  {
+    std::ofstream out(filename);
+    write_json(out);
+    return static_cast<bool>(out);
+  }
+
+protected:
+  struct thread_cache_entry {
+    uint64_t generation = 0;
+    trace_buffer* buffer = nullptr;
+  };
+
+  // A thread remembers the buffers of the last few recorders it used, so
+  // alternating between a couple of trackers does not register new buffers.
+  static constexpr int thread_cache_size = 4;
+
+  // Every recorder (and every `clear`) gets a new generation, so a stale
+  // cache entry of a thread is never mistaken for a valid one.
+  static uint64_t next_generation()
+  {
+    static std::atomic<uint64_t> counter(0);
+    return ++counter;
+  }
+
+  void record(const char* name, int64_t argument, clock_type::time_point begin, clock_type::time_point end)
+  {
+    thread_local std::array<thread_cache_entry, thread_cache_size> cache;
+    thread_local int next_entry = 0;
+
+    trace_buffer* buffer = nullptr;
+    for (const auto& entry : cache)
+      if (entry.generation == generation_)
+        buffer = entry.buffer;
+
+    if (buffer == nullptr) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      buffers_.push_back(std::make_unique<trace_buffer>(capacity_, buffers_.size()));
+      buffer = buffers_.back().get();
+      cache[next_entry] = { generation_, buffer };
+      next_entry = (next_entry + 1) % thread_cache_size;
+    }
+
+    using ns = std::chrono::nanoseconds;
+    buffer->push({ name, argument,
+                         static_cast<uint64_t>(std::chrono::duration_cast<ns>(begin - origin_).count()),
+                         static_cast<uint64_t>(std::chrono::duration_cast<ns>(end - begin).count()) });
+  }
+
+  bool enabled_;
+  size_t capacity_;
+  uint64_t generation_;
+  clock_type::time_point origin_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<trace_buffer>> buffers_;
+};
+
+}
+
+#endif
+
+/* vim: set ts=8 sts=2 sw=2 et ft=cpp: */
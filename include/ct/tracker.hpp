@@ -5,6 +5,28 @@ namespace ct {
 
 static constexpr int batch_size = 100;
 
+// Progress information passed to the callback of `tracker::run` after every
+// batch. The gap is relative to the lower bound and all times are wall clock
+// seconds accumulated since the start of `run`.
+struct run_progress {
+  int iterations;
+  cost lower_bound;
+  cost upper_bound;
+  cost gap;
+  double seconds;
+  double seconds_messages;
+  double seconds_rounding;
+  double seconds_bounds;
+};
+
+// Best primal found by `tracker::run`. Published snapshots are immutable, so
+// readers can inspect them without holding any lock.
+struct primal_snapshot {
+  std::vector<detection_primal> detections;
+  std::vector<conflict_primal> conflicts;
+  cost upper_bound;
+};
+
 template<typename ALLOCATOR = std::allocator<cost>>
 class tracker {
 public:
@@ -15,14 +37,565 @@ public:
   using conflict_node_type = typename graph_type::conflict_node_type;
 
   tracker(const ALLOCATOR& allocator = ALLOCATOR())
-  : graph_(allocator)
+  : tracker(allocator, allocator)
+  { }
+
+  tracker(const ALLOCATOR& allocator, const ALLOCATOR& cost_allocator)
+  : graph_(allocator, cost_allocator)
   , iterations_(0)
   , constant_(0)
+  , batch_size_(batch_size)
+  , verbose_(true)
+  , handle_signals_(false)
+  , cancel_requested_(false)
+  , published_lower_bound_(-std::numeric_limits<cost>::infinity())
+  , published_iterations_(0)
+  , conflict_min_rounds_(5)
+  , conflict_max_rounds_(5)
+  , conflict_tolerance_(0)
+  , initial_transition_weight_(1.0)
+  , transition_ramp_iterations_(0)
+  , transition_weight_(1.0)
+  , extrapolation_interval_(0)
+  , extrapolation_beta_(1.0)
+  , extrapolation_step_(1.0)
+  , extrapolation_countdown_(0)
+  , extrapolations_accepted_(0)
+  , extrapolations_rejected_(0)
+  , tile_sweeps_(0)
+  , tile_cache_bytes_(0)
+  , focus_window_size_(10)
+  , focus_sweeps_(0)
+  , window_size_(10)
+  , committed_timesteps_(0)
+  , dirty_first_(0)
+  , dirty_last_(0)
+  , checkpoint_interval_(0)
   { }
 
+  // Clears the graph and all solver state, so that the tracker can be reused
+  // for another model. The settings (batch size, callbacks, ...) and the
+  // Gurobi environment are kept. If the graph lives in a memory arena, the
+  // arena has to be reset by the caller afterwards.
+  void reset()
+  {
+    if (checkpoint_writer_.valid())
+      checkpoint_writer_.wait();
+
+    graph_.clear();
+    iterations_ = 0;
+    update_transition_weight(iterations_);
+    constant_ = 0;
+    cancel_requested_ = false;
+    committed_timesteps_ = 0;
+    dirty_first_ = dirty_last_ = 0;
+    extrapolation_previous_.clear();
+    extrapolation_step_ = extrapolation_beta_;
+    extrapolations_accepted_ = extrapolations_rejected_ = 0;
+    instrumentation_.begin_run(0);
+
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    best_primals_.reset();
+    spare_primals_.reset();
+    published_lower_bound_ = -std::numeric_limits<cost>::infinity();
+    published_iterations_ = 0;
+  }
+
   auto& get_graph() { return graph_; }
   const auto& get_graph() const { return graph_; }
 
+  // Number of iterations between two rounding steps. Progress is reported
+  // (and the callback invoked) once per batch.
+  void set_batch_size(int size) { assert(size >= 1); batch_size_ = size; }
+  int get_batch_size() const { return batch_size_; }
+
+  void set_verbose(bool verbose) { verbose_ = verbose; }
+
+  // Per-phase timing and counters of `run`, see `instrumentation`. The
+  // statistics of the most recent run stay available until the next one.
+  void set_instrumentation(bool enabled) { instrumentation_.set_enabled(enabled); }
+  const auto& get_instrumentation() const { return instrumentation_; }
+
+  // Additionally samples hardware counters per phase (only while the
+  // instrumentation is enabled). Returns false if they are not available.
+  bool set_hardware_counters(bool enabled) { return instrumentation_.set_hardware_counters(enabled); }
+
+  // Records a timeline of passes, timesteps, rounding and subsolver calls
+  // during `run` and writes it to `filename` in the Chrome trace-event
+  // format when `run` returns. `capacity` is the number of events kept per
+  // thread, older events are dropped. An empty filename disables tracing.
+  void set_trace(const std::string& filename, size_t capacity = trace_recorder::default_capacity)
+  {
+    trace_filename_ = filename;
+    tracer_.set_enabled(!filename.empty(), capacity);
+  }
+
+  const auto& get_trace() const { return tracer_; }
+
+  // If enabled, SIGINT stops `run` gracefully (after the current iteration).
+  // This is opt-in as the signal state is shared by the whole process.
+  void set_handle_signals(bool enabled) { handle_signals_ = enabled; }
+
+  // Requests termination of the current (or next) call to `run`. Together
+  // with `snapshot` the only method that may be called from another thread
+  // while `run` is active.
+  void cancel() { cancel_requested_ = true; }
+
+  // Returns the best primal published by `run` so far (or `nullptr`) together
+  // with the most recent lower bound and iteration count. This is safe to
+  // call from another thread while `run` is active. The lock is only held
+  // for copying a pointer and two numbers.
+  auto snapshot() const
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    return std::make_tuple(std::shared_ptr<const primal_snapshot>(best_primals_),
+                           published_lower_bound_, published_iterations_);
+  }
+
+  // Enables additional local sweeps in `run`: after the rounding of every
+  // batch, `sweeps` forward and backward passes are performed over the
+  // `window_size` consecutive timesteps with the largest local gap of the
+  // current primal (see `bounds_by_timestep`). They are not counted as
+  // iterations. Zero sweeps disable the focus (default).
+  void set_gap_focus(index window_size, int sweeps)
+  {
+    assert(window_size >= 1 && sweeps >= 0);
+    focus_window_size_ = window_size;
+    focus_sweeps_ = sweeps;
+  }
+
+  // Cache-blocked message passing in `run` (the rounding passes are not
+  // affected): instead of full passes over the graph, `sweeps` forward and
+  // backward passes are performed within a tile of consecutive timesteps
+  // before moving on to the next tile. The tiles are sized from the memory
+  // footprint of the timesteps, so that a tile fills about half of
+  // `cache_bytes`. If it is 0, the L2 cache is used, or the L3 cache if not
+  // even `min_tile_size` timesteps fit into the L2 cache. Neighboring tiles
+  // overlap by a quarter, so messages still travel through the whole graph.
+  // One round over all tiles counts as `sweeps` iterations. Zero sweeps
+  // restore full passes (default), as does a graph that fits into a single
+  // tile or whose tiles would be too short.
+  void set_tiling(int sweeps, size_t cache_bytes = 0)
+  {
+    assert(sweeps >= 0);
+    tile_sweeps_ = sweeps;
+    tile_cache_bytes_ = cache_bytes;
+  }
+
+  // Tiles [first, last) of the current graph, see `set_tiling`.
+  std::vector<std::pair<index, index>> tiles() const
+  {
+    std::vector<std::pair<index, index>> result;
+    if (tile_cache_bytes_ > 0) {
+      result = tiles(tile_cache_bytes_ / 2);
+    } else {
+      for (int level : { 2, 3 }) {
+        if (cache_size(level) == 0)
+          continue;
+        result = tiles(cache_size(level) / 2);
+        if (!result.empty())
+          break;
+      }
+    }
+
+    if (result.empty())
+      result.emplace_back(0, graph_.timesteps().size());
+    return result;
+  }
+
+  static constexpr index min_tile_size = 8;
+
+  // Parallel message passing in `run` on `threads` threads (including the
+  // calling one). Instead of sequential sweeps, every pass first updates
+  // all even and then all odd timesteps in parallel: a step only changes
+  // its own timestep and the neighbor in the direction of the pass, so
+  // steps of the same parity never touch the same factors. Messages travel
+  // two timesteps per pass instead of through the whole graph, so more
+  // iterations are needed, but they scale with the number of timesteps.
+  // The rounding stays sequential. During parallel passes the instrumentation
+  // does not attribute time to phases and the sweep observer is not called.
+  // One thread (default) restores the sequential sweeps. Takes precedence
+  // over `set_tiling`.
+  void set_parallel(int threads)
+  {
+    assert(threads >= 1);
+    if (threads <= 1)
+      pool_.reset();
+    else if (!pool_ || pool_->size() != threads)
+      pool_ = std::make_unique<thread_pool>(threads);
+  }
+
+  int get_parallel() const { return pool_ ? pool_->size() : 1; }
+
+  // Rounds of conflict messages at the start of every `single_step`. With
+  // `max_rounds` > `min_rounds`, the rounds stop early as soon as a round
+  // changes the detection costs of the conflicting detections by at most
+  // `tolerance` on average. Defaults to a fixed number of 5 rounds.
+  void set_conflict_rounds(int min_rounds, int max_rounds, cost tolerance)
+  {
+    assert(min_rounds >= 1 && max_rounds >= min_rounds && tolerance >= 0);
+    conflict_min_rounds_ = min_rounds;
+    conflict_max_rounds_ = max_rounds;
+    conflict_tolerance_ = tolerance;
+  }
+
+  // Damping of the transition messages: the weight grows linearly from
+  // `initial_weight` to 1 during the first `ramp_iterations` iterations
+  // (counted over all calls of `run`). Without damping (default) every
+  // message moves the full amount.
+  void set_transition_damping(double initial_weight, int ramp_iterations)
+  {
+    assert(initial_weight > 0 && initial_weight <= 1 && ramp_iterations >= 0);
+    initial_transition_weight_ = initial_weight;
+    transition_ramp_iterations_ = ramp_iterations;
+    update_transition_weight(iterations_);
+  }
+
+  double get_transition_weight() const { return transition_weight_; }
+
+  // Extrapolation of the reparametrization in `run`: every `interval`
+  // iterations all costs are moved further along the direction of the last
+  // `interval` iterations, i.e. to x + beta * (x - x_previous). Being an
+  // affine combination of two reparametrizations, the result is one as
+  // well. The step is only kept if the lower bound does not decrease,
+  // otherwise it is undone and the step size is halved (it doubles again
+  // after every accepted step, up to `beta`). Zero interval disables the
+  // extrapolation (default).
+  void set_extrapolation(int interval, double beta)
+  {
+    assert(interval >= 0 && beta > 0);
+    extrapolation_interval_ = interval;
+    extrapolation_beta_ = beta;
+    extrapolation_step_ = beta;
+  }
+
+  // Number of accepted and rejected extrapolation steps of the last `run`.
+  std::tuple<int, int> extrapolation_statistics() const
+  {
+    return std::make_tuple(extrapolations_accepted_, extrapolations_rejected_);
+  }
+
+  // Number of most recent timesteps that are optimized by `run_window`.
+  void set_window_size(index size) { assert(size >= 1); window_size_ = size; }
+  index get_window_size() const { return window_size_; }
+
+  // Timesteps before this index are committed, see `run_window`.
+  index number_of_committed_timesteps() const { return committed_timesteps_; }
+
+  // Periodically writes the solver state to `filename` during `run` (at most
+  // once every `interval` seconds, checked after each batch). The state is
+  // copied in memory and written by a background thread, a checkpoint is
+  // skipped if the previous one is still being written. An empty filename
+  // disables checkpointing.
+  void set_checkpoint(const std::string& filename, double interval)
+  {
+    checkpoint_filename_ = filename;
+    checkpoint_interval_ = interval;
+  }
+
+  // The observer is informed before a timestep is processed by a sweep over
+  // the graph (e.g. to manage residency of file-backed memory, see
+  // `residency_manager`).
+  void set_sweep_observer(std::function<void(index, bool)> observer) { sweep_observer_ = observer; }
+
+  // The callback is invoked once per batch. If it returns `true` the solver
+  // terminates after the current batch.
+  void set_progress_callback(std::function<bool(const run_progress&)> callback) { progress_callback_ = callback; }
+
+  //
+  // Checkpointing: The solver state (see `solver_state`) can be captured and
+  // restored. The graph must have the same structure in both cases. The
+  // stored primal is the best one found so far. As `run` continues with the
+  // current primal as incumbent, resuming from a state continues with
+  // exactly the same bounds.
+  //
+
+  void capture_state(solver_state& state) const
+  {
+    state.iterations = iterations_;
+    state.constant = constant_;
+    state.lower_bound = lower_bound();
+
+    state.costs.clear();
+    for_each_node([&](const auto* node) {
+      state.costs.insert(state.costs.end(), node->factor.data(), node->factor.data() + node->factor.size());
+    });
+
+    // The best published primal is preferred over the current one, as the
+    // latter is only the most recent rounding while `run` is active.
+    const auto best = std::get<0>(snapshot());
+    const primal_snapshot* primals = best.get();
+    primal_snapshot current;
+    if (!primals || primals->detections.size() != graph_.number_of_detections() ||
+        primals->conflicts.size() != graph_.number_of_conflicts()) {
+      resize_primal_storage(current, 0, graph_.timesteps().size());
+      visit_primal_storage(current, [](auto it, const auto& f) { *it = f.primal(); });
+      current.upper_bound = evaluate_primal();
+      primals = &current;
+    }
+
+    state.upper_bound = primals->upper_bound;
+    state.detection_primals.clear();
+    for (const auto& p : primals->detections) {
+      state.detection_primals.push_back(p.incoming());
+      state.detection_primals.push_back(p.outgoing());
+    }
+    state.conflict_primals.clear();
+    for (const auto& p : primals->conflicts)
+      state.conflict_primals.push_back(p.get());
+  }
+
+  // Returns `false` if the state does not match the graph. The tracker is
+  // left untouched in this case.
+  bool restore_state(const solver_state& state)
+  {
+    size_t number_of_costs = 0;
+    for_each_node([&](const auto* node) { number_of_costs += node->factor.size(); });
+    if (state.costs.size() != number_of_costs ||
+        state.number_of_detections() != graph_.number_of_detections() ||
+        state.number_of_conflicts() != graph_.number_of_conflicts())
+      return false;
+
+    // Every primal has to refer to an existing slot (the last one being the
+    // appearance/disappearance) before anything is overwritten.
+    auto valid_slot = [](index value, size_t size) {
+      return value == detection_primal::undecided || value <= size;
+    };
+    auto check_detection = state.detection_primals.cbegin();
+    auto check_conflict = state.conflict_primals.cbegin();
+    for (const auto& timestep : graph_.timesteps()) {
+      for (const auto* node : timestep.detections) {
+        const index incoming = *check_detection++;
+        const index outgoing = *check_detection++;
+        if (incoming != detection_primal::off &&
+            (!valid_slot(incoming, node->incoming.size()) || !valid_slot(outgoing, node->outgoing.size())))
+          return false;
+      }
+
+      for (const auto* node : timestep.conflicts) {
+        const index slot = *check_conflict++;
+        if (slot != conflict_primal::undecided && slot > node->detections.size())
+          return false;
+      }
+    }
+
+    auto it_cost = state.costs.cbegin();
+    for_each_node([&](const auto* node) {
+      std::copy(it_cost, it_cost + node->factor.size(), node->factor.data());
+      it_cost += node->factor.size();
+    });
+
+    auto it_detection = state.detection_primals.cbegin();
+    auto it_conflict = state.conflict_primals.cbegin();
+    for (const auto& timestep : graph_.timesteps()) {
+      for (const auto* node : timestep.detections) {
+        auto& p = node->factor.primal();
+        const index incoming = *it_detection++;
+        const index outgoing = *it_detection++;
+        p.reset();
+        if (incoming == detection_primal::off) {
+          p.set_detection_off();
+        } else {
+          if (incoming != detection_primal::undecided)
+            p.set_incoming(incoming);
+          if (outgoing != detection_primal::undecided)
+            p.set_outgoing(outgoing);
+        }
+      }
+
+      for (const auto* node : timestep.conflicts) {
+        auto& p = node->factor.primal();
+        p.reset();
+        if (*it_conflict != conflict_primal::undecided)
+          p.set(*it_conflict);
+        ++it_conflict;
+      }
+    }
+
+    invalidate_cached_minima();
+    iterations_ = state.iterations;
+    update_transition_weight(iterations_);
+    constant_ = state.constant;
+    return true;
+  }
+
+  bool save_state(const std::string& filename) const
+  {
+    solver_state state;
+    capture_state(state);
+    return state.write_file(filename);
+  }
+
+  bool load_state(const std::string& filename)
+  {
+    try {
+      solver_state state;
+      return state.read_file(filename) && restore_state(state);
+    } catch (const std::exception&) {
+      return false;
+    }
+  }
+
+  //
+  // Initialization: `graph::set_transition_cost` distributes the cost of
+  // every transition and division evenly among the attached detections.
+  // Before `run`, this distribution can be improved by `initialize` or
+  // replaced by the reparametrization of a previous solve of a related model
+  // (see `reparametrization`).
+  //
+
+  // Quick initial reparametrization in a single sweep over the timesteps:
+  // The conflicts (which start at zero) receive one round of messages, then
+  // the cost of every transition and division is redistributed such that
+  // the min-marginals of the edge agree in all attached detections. This
+  // never decreases the lower bound and costs less than one iteration.
+  void initialize()
+  {
+#ifndef NDEBUG
+    auto lb_before = this->lower_bound();
+#endif
+
+    auto span = tracer_.trace("initialize");
+    for (const auto& t : graph_.timesteps()) {
+      for (const auto* node : t.conflicts)
+        conflict_messages::send_messages_to_conflict(node);
+
+      for (const auto* node : t.conflicts)
+        conflict_messages::send_messages_to_detection(node);
+
+      for (const auto* node : t.detections)
+        transition_messages::average_min_marginals(node);
+    }
+
+#ifndef NDEBUG
+    auto lb_after = this->lower_bound();
+    assert(lb_before <= lb_after + epsilon);
+#endif
+  }
+
+  void capture_reparametrization(reparametrization& r) const
+  {
+    r.clear();
+    for (const auto& s : graph_.transitions()) {
+      const auto* node = graph_.detection(s.timestep, s.detection);
+      const auto& edge = node->outgoing[s.slot];
+      r.transition_keys.insert(r.transition_keys.end(), { s.timestep, s.detection, s.slot });
+      r.transition_deviations.push_back(0.5 * (node->factor.outgoing(s.slot) - edge.node1->factor.incoming(edge.slot1)));
+    }
+
+    for (const auto& s : graph_.divisions()) {
+      const auto* node = graph_.detection(s.timestep, s.detection);
+      const auto& edge = node->outgoing[s.slot];
+      const cost outgoing = node->factor.outgoing(s.slot);
+      const cost incoming_1 = edge.node1->factor.incoming(edge.slot1);
+      const cost mean = (outgoing + incoming_1 + edge.node2->factor.incoming(edge.slot2)) / 3;
+      r.division_keys.insert(r.division_keys.end(), { s.timestep, s.detection, s.slot });
+      r.division_deviations.insert(r.division_deviations.end(), { outgoing - mean, incoming_1 - mean });
+    }
+
+    const auto& timesteps = graph_.timesteps();
+    for (index timestep = 0; timestep < timesteps.size(); ++timestep) {
+      for (index conflict = 0; conflict < timesteps[timestep].conflicts.size(); ++conflict) {
+        const auto& c = timesteps[timestep].conflicts[conflict]->factor;
+        for (index slot = 0; slot + 1 < c.size(); ++slot) {
+          r.conflict_keys.insert(r.conflict_keys.end(), { timestep, conflict, slot });
+          r.conflict_costs.push_back(c.data()[slot]);
+        }
+      }
+    }
+  }
+
+  // Moves the transitions, divisions and conflict slots that exist in both
+  // models to the stored distribution. Entries that do not match the graph
+  // (unknown keys, or a transition that is a division here) or that store a
+  // non-finite value are skipped, so the models only need a similar
+  // structure. This is a valid
+  // reparametrization of the current model, but (unlike `restore_state`)
+  // the lower bound may be worse than before if the models differ too much.
+  // Returns the number of applied entries.
+  size_t apply_reparametrization(const reparametrization& r)
+  {
+    const auto& timesteps = graph_.timesteps();
+    auto find_edge = [&](const uint32_t* key, bool division) -> const detection_node_type* {
+      if (size_t(key[0]) + 1 >= timesteps.size() || key[1] >= timesteps[key[0]].detections.size())
+        return nullptr;
+      const auto* node = timesteps[key[0]].detections[key[1]];
+      if (key[2] >= node->outgoing.size() || node->outgoing[key[2]].is_division() != division)
+        return nullptr;
+      return node;
+    };
+
+    size_t applied = 0;
+    for (size_t i = 0; i < r.number_of_transitions(); ++i) {
+      const uint32_t* key = &r.transition_keys[3 * i];
+      const auto* node = find_edge(key, false);
+      if (node == nullptr || !std::isfinite(r.transition_deviations[i]))
+        continue;
+
+      const auto& edge = node->outgoing[key[2]];
+      const cost deviation = 0.5 * (node->factor.outgoing(key[2]) - edge.node1->factor.incoming(edge.slot1));
+      const cost delta = r.transition_deviations[i] - deviation;
+      node->factor.repam_outgoing(key[2], delta);
+      edge.node1->factor.repam_incoming(edge.slot1, -delta);
+      ++applied;
+    }
+
+    for (size_t i = 0; i < r.number_of_divisions(); ++i) {
+      const uint32_t* key = &r.division_keys[3 * i];
+      const auto* node = find_edge(key, true);
+      if (node == nullptr || !std::isfinite(r.division_deviations[2 * i]) ||
+          !std::isfinite(r.division_deviations[2 * i + 1]))
+        continue;
+
+      const auto& edge = node->outgoing[key[2]];
+      const cost outgoing = node->factor.outgoing(key[2]);
+      const cost incoming_1 = edge.node1->factor.incoming(edge.slot1);
+      const cost mean = (outgoing + incoming_1 + edge.node2->factor.incoming(edge.slot2)) / 3;
+      const cost delta_0 = r.division_deviations[2 * i] - (outgoing - mean);
+      const cost delta_1 = r.division_deviations[2 * i + 1] - (incoming_1 - mean);
+      node->factor.repam_outgoing(key[2], delta_0);
+      edge.node1->factor.repam_incoming(edge.slot1, delta_1);
+      edge.node2->factor.repam_incoming(edge.slot2, -delta_0 - delta_1);
+      ++applied;
+    }
+
+    for (size_t i = 0; i < r.number_of_conflict_slots(); ++i) {
+      const uint32_t* key = &r.conflict_keys[3 * i];
+      if (key[0] >= timesteps.size() || key[1] >= timesteps[key[0]].conflicts.size())
+        continue;
+      const auto* node = timesteps[key[0]].conflicts[key[1]];
+      if (key[2] >= node->detections.size() || !std::isfinite(r.conflict_costs[i]))
+        continue;
+
+      const cost delta = r.conflict_costs[i] - node->factor.data()[key[2]];
+      node->factor.repam(key[2], delta);
+      node->detections[key[2]].node->factor.repam_detection(-delta);
+      ++applied;
+    }
+
+    return applied;
+  }
+
+  bool save_reparametrization(const std::string& filename) const
+  {
+    reparametrization r;
+    capture_reparametrization(r);
+    return r.write_file(filename);
+  }
+
+  // Returns the number of applied entries or -1 if the file is not readable.
+  int64_t load_reparametrization(const std::string& filename)
+  {
+    try {
+      reparametrization r;
+      if (!r.read_file(filename))
+        return -1;
+      return apply_reparametrization(r);
+    } catch (const std::exception&) {
+      return -1;
+    }
+  }
+
   cost lower_bound() const
   {
     graph_.check_structure();
@@ -37,17 +610,30 @@ public:
 
   cost evaluate_primal() const
   {
-    const cost inf = std::numeric_limits<cost>::infinity();
-    cost result = constant_;
+    return constant_ + evaluate_primal(0, graph_.timesteps().size());
+  }
 
-    for_each_node(
-      [&](const auto* node) {
-        if (!check_primal_consistency(node))
-          result += inf;
-        result += node->factor.evaluate_primal();
-      });
+  // Contributions of the factors of every timestep to `lower_bound` and
+  // `evaluate_primal` (without the constant). The difference is the local
+  // share of the gap, it can be negative for single timesteps but sums up to
+  // the global gap.
+  void bounds_by_timestep(std::vector<cost>& lower_bounds, std::vector<cost>& upper_bounds) const
+  {
+    graph_.check_structure();
+    const index number_of_timesteps = graph_.timesteps().size();
+    lower_bounds.resize(number_of_timesteps);
+    upper_bounds.resize(number_of_timesteps);
+    for (index t = 0; t < number_of_timesteps; ++t) {
+      lower_bounds[t] = lower_bound(t, t + 1);
+      upper_bounds[t] = evaluate_primal(t, t + 1);
+    }
+  }
 
-    return result;
+  // Must be called after the costs were written directly (see
+  // `detection_factor::data`). `run` and `resolve` do this on their own.
+  void invalidate_cached_minima() const
+  {
+    invalidate_cached_minima(0, graph_.timesteps().size());
   }
 
   cost upper_bound() const { return evaluate_primal(); }
@@ -65,32 +651,42 @@ public:
   {
     const auto& timesteps = graph_.timesteps();
     assert(timestep_idx >= 0 && timestep_idx < timesteps.size());
+    invalidate_cached_minima(timestep_idx > 0 ? timestep_idx - 1 : 0, std::min<index>(timestep_idx + 2, timesteps.size()));
     single_step<forward, false>(timesteps[timestep_idx]); // Rounding is disabled here.
   }
 
   template<bool forward, bool rounding>
   void single_pass()
+  {
+    single_pass<forward, rounding>(0, graph_.timesteps().size());
+  }
+
+  // Same as above, but restricted to the timesteps in [first, last).
+  template<bool forward, bool rounding>
+  void single_pass(const index first, const index last)
   {
 #ifndef NDEBUG
     auto lb_before = this->lower_bound();
 #endif
 
-    auto runner = [&](auto begin, auto end) {
-      for (auto it = begin; it != end; ++it) {
-        this->single_step<forward, rounding>(*it);
-      }
+    const auto& timesteps = graph_.timesteps();
+    assert(first >= 0 && first <= last && last <= timesteps.size());
+    auto span = tracer_.trace(forward ? "forward_pass" : "backward_pass");
+    auto step = [&](const index t) {
+      if (sweep_observer_)
+        sweep_observer_(t, forward);
+      this->single_step<forward, rounding>(timesteps[t]);
     };
 
-    const auto& timesteps = graph_.timesteps();
     if constexpr (forward)
-      runner(timesteps.begin(), timesteps.end());
+      for (index t = first; t < last; ++t)
+        step(t);
     else
-      runner(timesteps.rbegin(), timesteps.rend());
+      for (index t = last; t-- > first; )
+        step(t);
 
     if constexpr (rounding)
-      for (const auto& timestep : timesteps)
-        for (const auto* node : timestep.detections)
-          node->factor.fix_primal();
+      fix_primals(first, last);
 
 #ifndef NDEBUG
     auto lb_after = this->lower_bound();
@@ -101,88 +697,758 @@ public:
   template<bool rounding=false> void forward_pass() { single_pass<true, rounding>(); }
   template<bool rounding=false> void backward_pass() { single_pass<false, rounding>(); }
 
-  void run(const int max_iterations = 1000)
+  // Pass of the parallel mode, see `set_parallel`. Runs sequentially if no
+  // threads are configured.
+  template<bool forward>
+  void parallel_pass()
   {
-    graph_.check_structure();
-    const int max_batches = (max_iterations + batch_size - 1) / batch_size;
+#ifndef NDEBUG
+    auto lb_before = this->lower_bound();
+#endif
+
+    auto span = tracer_.trace(forward ? "parallel_forward_pass" : "parallel_backward_pass");
     const auto& timesteps = graph_.timesteps();
 
-    std::vector<detection_primal> best_detection_primals(graph_.number_of_detections());
-    std::vector<conflict_primal> best_conflict_primals(graph_.number_of_conflicts());
+    // The lazy classification of the timesteps is not thread-safe.
+    for (const auto& t : timesteps)
+      t.classify();
+
+    const bool instrumented = instrumentation_.enabled();
+    instrumentation_.set_enabled(false);
+    for (index parity : { 0, 1 }) {
+      const index count = (timesteps.size() + 1 - parity) / 2;
+      auto step = [&](const index i) { this->single_step<forward, false>(timesteps[2 * i + parity]); };
+      if (pool_)
+        pool_->parallel_for(count, step);
+      else
+        for (index i = 0; i < count; ++i)
+          step(i);
+    }
+    instrumentation_.set_enabled(instrumented);
+
+#ifndef NDEBUG
+    auto lb_after = this->lower_bound();
+    assert(lb_before <= lb_after + epsilon);
+#endif
+  }
+
+  void run(const int max_iterations = 1000)
+  {
+    graph_.check_structure();
+    invalidate_cached_minima();
+    const int max_batches = (max_iterations + batch_size_ - 1) / batch_size_;
     cost best_ub = std::numeric_limits<cost>::infinity();
 
-    auto visit_primal_storage = [&](auto functor) {
-      auto it_detection = best_detection_primals.begin();
-      auto it_conflict = best_conflict_primals.begin();
-      for (const auto& t : timesteps) {
-        for (const auto* node : t.detections) {
-          assert(it_detection != best_detection_primals.end());
-          functor(it_detection++, node->factor);
-        }
-        for (const auto* node : t.conflicts) {
-          assert(it_conflict != best_conflict_primals.end());
-          functor(it_conflict++, node->factor);
-        }
-      }
-      assert(it_detection == best_detection_primals.end());
-      assert(it_conflict == best_conflict_primals.end());
-    };
+    instrumentation_.begin_run(graph_.timesteps().size());
+    if (tracer_.enabled())
+      tracer_.clear();
 
     auto remember_best_primals = [&]() {
-      auto ub = this->evaluate_primal();
+      cost ub;
+      {
+        auto span = tracer_.trace("evaluate_primal");
+        auto probe = instrumentation_.measure(phase::evaluate_primal);
+        ub = this->evaluate_primal();
+        instrumentation_.count(counter::candidates_evaluated);
+      }
       if (ub < best_ub) {
+        auto probe = instrumentation_.measure(phase::primal_copy);
         best_ub = ub;
-        visit_primal_storage([&](auto it, const auto& f) { *it = f.primal(); });
+        publish_best_primals(ub);
       }
     };
 
     auto restore_best_primals = [&] () {
-      visit_primal_storage([&](auto it, auto& f) { f.primal() = *it++; });
+      auto probe = instrumentation_.measure(phase::primal_copy);
+      if (best_ub < std::numeric_limits<cost>::infinity())
+        visit_primal_storage(*best_primals_, [&](auto it, auto& f) { f.primal() = *it; });
     };
 
-    signal_handler h;
+    // The primal of a previous call (or of a restored state) is the initial
+    // incumbent.
+    remember_best_primals();
+
+    signal_handler h(handle_signals_);
+    auto should_stop = [&]() { return cancel_requested_ || h.signaled(); };
+
     using clock_type = std::chrono::high_resolution_clock;
+    using seconds_type = std::chrono::duration<double>;
     const auto clock_start = clock_type::now();
-    std::cout.precision(std::numeric_limits<cost>::max_digits10);
-    for (int i = 0; i < max_batches && !h.signaled(); ++i) {
-      for (int j = 0; j < batch_size-1; ++j) {
-        forward_pass<false>();
-        backward_pass<false>();
+    double last_checkpoint = 0;
+
+    run_progress progress = {};
+    auto stopwatch = [&](double& accumulator, auto functor) {
+      const auto begin = clock_type::now();
+      functor();
+      accumulator += seconds_type(clock_type::now() - begin).count();
+    };
+
+    const auto tiling = tile_sweeps_ > 0 ? tiles() : std::vector<std::pair<index, index>>();
+    extrapolation_previous_.clear();
+    extrapolation_countdown_ = extrapolation_interval_;
+    extrapolation_step_ = extrapolation_beta_;
+    extrapolations_accepted_ = extrapolations_rejected_ = 0;
+
+    bool stop = false;
+    for (int i = 0; i < max_batches && !stop && !should_stop(); ++i) {
+      auto span = tracer_.trace("batch", i);
+      stopwatch(progress.seconds_messages, [&]() {
+        if (pool_) {
+          for (int j = 0; j < batch_size_-1 && !should_stop(); ++j) {
+            update_transition_weight(this->iterations_ + j);
+            parallel_pass<true>();
+            parallel_pass<false>();
+            count_for_extrapolation(1);
+          }
+        } else if (tiling.size() > 1) {
+          for (int j = 0; j < batch_size_-1 && !should_stop(); j += tile_sweeps_) {
+            update_transition_weight(this->iterations_ + j);
+            for (const auto& [first, last] : tiling)
+              for (int k = 0; k < std::min(tile_sweeps_, batch_size_-1 - j); ++k) {
+                single_pass<true, false>(first, last);
+                single_pass<false, false>(first, last);
+              }
+            count_for_extrapolation(std::min(tile_sweeps_, batch_size_-1 - j));
+          }
+        } else {
+          for (int j = 0; j < batch_size_-1 && !should_stop(); ++j) {
+            update_transition_weight(this->iterations_ + j);
+            forward_pass<false>();
+            backward_pass<false>();
+            count_for_extrapolation(1);
+          }
+        }
+        update_transition_weight(this->iterations_ + batch_size_ - 1);
+      });
+
+      stopwatch(progress.seconds_rounding, [&]() {
+        this->reset_primal();
+        forward_pass<true>();
+      });
+      stopwatch(progress.seconds_bounds, remember_best_primals);
+
+      stopwatch(progress.seconds_rounding, [&]() {
+        this->reset_primal();
+        backward_pass<true>();
+      });
+      stopwatch(progress.seconds_bounds, remember_best_primals);
+
+      if (focus_sweeps_ > 0)
+        stopwatch(progress.seconds_messages, [&]() { focus_on_gap(should_stop); });
+
+      cost lb;
+      stopwatch(progress.seconds_bounds, [&]() {
+        auto span = tracer_.trace("lower_bound");
+        auto probe = instrumentation_.measure(phase::lower_bound);
+        lb = this->lower_bound();
+      });
+
+      this->iterations_ += batch_size_;
+      instrumentation_.end_batch(this->iterations_);
+      publish_lower_bound(lb);
+      progress.iterations = this->iterations_;
+      progress.lower_bound = lb;
+      progress.upper_bound = best_ub;
+      progress.gap = (best_ub - lb) / std::abs(lb);
+      progress.seconds = seconds_type(clock_type::now() - clock_start).count();
+
+      stop = report_progress(progress);
+
+      if (!checkpoint_filename_.empty() && progress.seconds - last_checkpoint >= checkpoint_interval_)
+        if (start_checkpoint())
+          last_checkpoint = progress.seconds;
+    }
+
+    restore_best_primals();
+    cancel_requested_ = false;
+
+    if (!trace_filename_.empty() && !tracer_.write_json(trace_filename_))
+      std::cerr << "[ct] writing trace failed" << std::endl;
+  }
+
+  //
+  // Online mode: New timesteps can be appended to the graph at any time (the
+  // memory must not be finalized and the outgoing side of the previously last
+  // timestep can be enlarged via `graph::resize_outgoing`).
+  //
+  // `run_window` optimizes only the most recent `window_size` timesteps. The
+  // last committed timestep takes part in the message passing and its
+  // outgoing decisions are rounded together with the window, all earlier
+  // timesteps stay untouched. Afterwards all timesteps that dropped out of
+  // the window are committed: their detection state and incoming decisions
+  // are final. (The outgoing decisions of a committed timestep become final
+  // once its successor is committed.)
+  //
+  // The call returns after `max_iterations` or when `max_seconds` are used
+  // up. The time budget is soft: at least one rounding is performed and the
+  // message passing stops early enough to fit the duration of the previous
+  // rounding into the budget. The cost of a call only depends on the window
+  // size, not on the number of committed timesteps.
+  //
+  // NOTE: The memory of committed timesteps is not released, as the
+  //       underlying arena only supports append operations.
+  //
+  void run_window(const int max_iterations = 1000, const double max_seconds = std::numeric_limits<double>::infinity())
+  {
+#ifndef NDEBUG
+    graph_.check_structure();
+#endif
+    const index first = committed_timesteps_;
+    const index last = graph_.timesteps().size();
+    if (first >= last)
+      return;
+
+    // The last committed timestep participates in message passing and in
+    // the rounding of outgoing decisions.
+    const index boundary = first > 0 ? first - 1 : first;
+
+    primal_snapshot best;
+    best.upper_bound = std::numeric_limits<cost>::infinity();
+    resize_primal_storage(best, boundary, last);
+
+    auto remember_best_primals = [&]() {
+      auto ub = this->evaluate_primal(boundary, last);
+      if (ub < best.upper_bound) {
+        best.upper_bound = ub;
+        visit_primal_storage(best, [](auto it, const auto& f) { *it = f.primal(); }, boundary, last);
       }
+    };
 
-      this->reset_primal();
-      forward_pass<true>();
-      remember_best_primals();
+    signal_handler h(handle_signals_);
+    auto should_stop = [&]() { return cancel_requested_ || h.signaled(); };
 
-      this->reset_primal();
-      backward_pass<true>();
+    using clock_type = std::chrono::high_resolution_clock;
+    using seconds_type = std::chrono::duration<double>;
+    const auto clock_start = clock_type::now();
+    auto elapsed = [&]() { return seconds_type(clock_type::now() - clock_start).count(); };
+
+    run_progress progress = {};
+    double last_rounding = 0;
+    int iterations = 0;
+    bool stop = false;
+    while (!stop) {
+      const auto messages_start = elapsed();
+      for (int j = 0; j < batch_size_-1 && iterations < max_iterations - 1; ++j) {
+        if (should_stop() || elapsed() + last_rounding >= max_seconds) {
+          stop = true;
+          break;
+        }
+
+        single_pass<true, false>(boundary, last);
+        single_pass<false, false>(first, last);
+        ++iterations;
+      }
+
+      const auto rounding_start = elapsed();
+      progress.seconds_messages += rounding_start - messages_start;
+      round_window<true>(first, last);
+      remember_best_primals();
+      round_window<false>(first, last);
       remember_best_primals();
+      ++iterations;
+      last_rounding = elapsed() - rounding_start;
+      progress.seconds_rounding += last_rounding;
 
-      const auto clock_now = clock_type::now();
-      const std::chrono::duration<double> seconds = clock_now - clock_start;
+      this->iterations_ += iterations - progress.iterations;
+      progress.iterations = iterations;
+      progress.lower_bound = lower_bound(boundary, last);
+      progress.upper_bound = best.upper_bound;
+      progress.gap = (progress.upper_bound - progress.lower_bound) / std::abs(progress.lower_bound);
+      progress.seconds = elapsed();
 
-      const auto lb = this->lower_bound();
-      this->iterations_ += batch_size;
-      std::cout << "it=" << this->iterations_ << " "
-                << "lb=" << lb << " "
-                << "ub=" << best_ub << " "
-                << "gap=" << static_cast<float>(100.0 * (best_ub - lb) / std::abs(lb)) << "% "
-                << "t=" << seconds.count() << std::endl;
+      stop = report_progress(progress) || stop || should_stop() ||
+        iterations >= max_iterations || progress.seconds + last_rounding >= max_seconds;
     }
 
-    restore_best_primals();
+    visit_primal_storage(best, [](auto it, auto& f) { f.primal() = *it; }, boundary, last);
+    if (last > window_size_)
+      committed_timesteps_ = std::max(committed_timesteps_, last - window_size_);
+    cancel_requested_ = false;
+  }
+
+  //
+  // Incremental updates: The costs of an already solved tracker hold the
+  // current reparametrization, so they must not be overwritten with the
+  // `set_*` methods of the factors. Instead, changes of the original costs
+  // are applied as a delta on top of the reparametrization, which keeps the
+  // dual state of all unaffected factors valid. The touched timesteps are
+  // remembered and `resolve` re-optimizes only this region.
+  //
+
+  void add_detection_cost(const index timestep, const index detection, const cost delta)
+  {
+    graph_.detection(timestep, detection)->factor.repam_detection(delta);
+    mark_dirty(timestep, timestep + 1);
+  }
+
+  void add_appearance_cost(const index timestep, const index detection, const cost delta)
+  {
+    graph_.detection(timestep, detection)->factor.repam_appearance(delta);
+    mark_dirty(timestep, timestep + 1);
+  }
+
+  void add_disappearance_cost(const index timestep, const index detection, const cost delta)
+  {
+    graph_.detection(timestep, detection)->factor.repam_disappearance(delta);
+    mark_dirty(timestep, timestep + 1);
+  }
+
+  // Changes the cost of the transition or division leaving the given
+  // outgoing slot. The delta is split evenly among all detection factors
+  // attached to the edge.
+  void add_transition_cost(const index timestep, const index detection, const index slot, const cost delta)
+  {
+    const auto* node = graph_.detection(timestep, detection);
+    const auto& edge = node->outgoing[slot];
+    if (edge.is_division()) {
+      node->factor.repam_outgoing(slot, delta / 3);
+      edge.node1->factor.repam_incoming(edge.slot1, delta / 3);
+      edge.node2->factor.repam_incoming(edge.slot2, delta / 3);
+    } else {
+      node->factor.repam_outgoing(slot, delta / 2);
+      edge.node1->factor.repam_incoming(edge.slot1, delta / 2);
+    }
+    mark_dirty(timestep, timestep + 2);
+  }
+
+  bool is_dirty() const { return dirty_first_ < dirty_last_; }
+
+  // Continues from the current dual state after incremental updates. The
+  // message passing is restricted to the touched timesteps plus `margin`
+  // timesteps on both sides. Afterwards the whole graph is rounded once in
+  // each direction and the best primal (including the previous one,
+  // evaluated with the updated costs) is kept.
+  void resolve(const int max_iterations = 100, const index margin = 10)
+  {
+    if (!is_dirty())
+      return;
+
+    graph_.check_structure();
+    invalidate_cached_minima();
+    const index first = dirty_first_ > margin ? dirty_first_ - margin : 0;
+    const index last = std::min<index>(dirty_last_ + margin, graph_.timesteps().size());
+
+    signal_handler h(handle_signals_);
+    auto should_stop = [&]() { return cancel_requested_ || h.signaled(); };
+
+    int i = 0;
+    for (; i < max_iterations && !should_stop(); ++i) {
+      single_pass<true, false>(first, last);
+      single_pass<false, false>(first, last);
+    }
+    this->iterations_ += i;
+
+    cost best_ub = this->evaluate_primal();
+    if (best_ub < std::numeric_limits<cost>::infinity())
+      publish_best_primals(best_ub);
+
+    auto round = [&](auto pass) {
+      this->reset_primal();
+      pass();
+      auto ub = this->evaluate_primal();
+      if (ub < best_ub) {
+        best_ub = ub;
+        publish_best_primals(ub);
+      }
+    };
+    round([&]() { forward_pass<true>(); });
+    round([&]() { backward_pass<true>(); });
+
+    if (best_ub < std::numeric_limits<cost>::infinity())
+      visit_primal_storage(*best_primals_, [&](auto it, auto& f) { f.primal() = *it; });
+    publish_lower_bound(this->lower_bound());
+
+    dirty_first_ = dirty_last_ = 0;
+    cancel_requested_ = false;
+  }
+
+  // Commits all remaining timesteps with their current primals (e.g. at the
+  // end of an experiment). Must be called after `run_window`.
+  void commit_window()
+  {
+    committed_timesteps_ = graph_.timesteps().size();
   }
 
 protected:
 
+  // Captures the state in memory and hands it over to a background thread.
+  // Returns `false` if the previous checkpoint is still being written.
+  bool start_checkpoint()
+  {
+    using namespace std::chrono_literals;
+    if (checkpoint_writer_.valid()) {
+      if (checkpoint_writer_.wait_for(0s) != std::future_status::ready)
+        return false;
+      if (!checkpoint_writer_.get())
+        std::cerr << "[ct] writing checkpoint failed" << std::endl;
+    }
+
+    if (!checkpoint_state_)
+      checkpoint_state_ = std::make_shared<solver_state>();
+    capture_state(*checkpoint_state_);
+
+    checkpoint_writer_ = std::async(std::launch::async,
+      [state = checkpoint_state_, filename = checkpoint_filename_]() {
+        return state->write_file(filename);
+      });
+    return true;
+  }
+
+  void mark_dirty(const index first, const index last)
+  {
+    if (is_dirty()) {
+      dirty_first_ = std::min(dirty_first_, first);
+      dirty_last_ = std::max(dirty_last_, last);
+    } else {
+      dirty_first_ = first;
+      dirty_last_ = last;
+    }
+  }
+
+  // Prints the progress line (if verbose) and invokes the progress callback.
+  // Returns `true` if the callback requests termination.
+  bool report_progress(const run_progress& progress)
+  {
+    if (verbose_) {
+      // We format the line locally, so that concurrently running trackers
+      // neither share stream state nor interleave their output.
+      std::ostringstream line;
+      line.precision(std::numeric_limits<cost>::max_digits10);
+      line << "it=" << this->iterations_ << " "
+           << "lb=" << progress.lower_bound << " "
+           << "ub=" << progress.upper_bound << " "
+           << "gap=" << static_cast<float>(100.0 * progress.gap) << "% "
+           << "t=" << progress.seconds << "\n";
+      std::cout << line.str() << std::flush;
+    }
+
+    if (progress_callback_)
+      return progress_callback_(progress);
+
+    return false;
+  }
+
+  void invalidate_cached_minima(const index first, const index last) const
+  {
+    const auto& timesteps = graph_.timesteps();
+    for (index t = first; t < last; ++t) {
+      if (sweep_observer_)
+        sweep_observer_(t, true);
+
+      for (const auto* node : timesteps[t].detections)
+        node->factor.invalidate_cached_minima();
+    }
+  }
+
+  cost lower_bound(const index first, const index last) const
+  {
+    cost result = 0;
+    for_each_node([&result](const auto* node) {
+      result += node->factor.lower_bound();
+    }, first, last);
+    return result;
+  }
+
+  cost evaluate_primal(const index first, const index last) const
+  {
+    const cost inf = std::numeric_limits<cost>::infinity();
+    cost result = 0;
+
+    for_each_node(
+      [&](const auto* node) {
+        if (!check_primal_consistency(node))
+          result += inf;
+        result += node->factor.evaluate_primal();
+      }, first, last);
+
+    return result;
+  }
+
+  void count_for_extrapolation(const int iterations)
+  {
+    if (extrapolation_interval_ <= 0)
+      return;
+
+    extrapolation_countdown_ -= iterations;
+    if (extrapolation_countdown_ <= 0) {
+      extrapolation_countdown_ = extrapolation_interval_;
+      extrapolate();
+    }
+  }
+
+  // See `set_extrapolation`.
+  void extrapolate()
+  {
+    auto span = tracer_.trace("extrapolation");
+    auto& current = extrapolation_current_;
+    auto& previous = extrapolation_previous_;
+
+    current.clear();
+    for_each_node([&](const auto* node) {
+      current.insert(current.end(), node->factor.data(), node->factor.data() + node->factor.size());
+    });
+
+    if (previous.size() == current.size()) {
+      const cost lb_before = this->lower_bound();
+      const cost beta = extrapolation_step_;
+      auto it_current = current.cbegin();
+      auto it_previous = previous.cbegin();
+      for_each_node([&](const auto* node) {
+        auto* costs = node->factor.data();
+        for (size_t i = 0; i < node->factor.size(); ++i) {
+          const auto x = *it_current++, y = *it_previous++;
+          if (std::isfinite(x) && std::isfinite(y))
+            costs[i] = x + beta * (x - y);
+        }
+      });
+      invalidate_cached_minima();
+
+      if (this->lower_bound() >= lb_before) {
+        ++extrapolations_accepted_;
+        extrapolation_step_ = std::min(2 * extrapolation_step_, extrapolation_beta_);
+        // The next direction starts from the extrapolated costs.
+        current.clear();
+        for_each_node([&](const auto* node) {
+          current.insert(current.end(), node->factor.data(), node->factor.data() + node->factor.size());
+        });
+      } else {
+        ++extrapolations_rejected_;
+        extrapolation_step_ *= 0.5;
+        auto it = current.cbegin();
+        for_each_node([&](const auto* node) {
+          std::copy(it, it + node->factor.size(), node->factor.data());
+          it += node->factor.size();
+        });
+        invalidate_cached_minima();
+      }
+    }
+
+    std::swap(previous, current);
+  }
+
+  void update_transition_weight(const int iteration)
+  {
+    if (iteration >= transition_ramp_iterations_)
+      transition_weight_ = 1.0;
+    else
+      transition_weight_ = initial_transition_weight_ + (1.0 - initial_transition_weight_) * iteration / transition_ramp_iterations_;
+  }
+
+  // Detection costs of all conflict links of the timestep (in the order of
+  // the links), see `set_conflict_rounds`.
+  static void store_conflicting_detection_costs(const timestep_type& t, std::vector<cost>& costs)
+  {
+    costs.clear();
+    for (const auto* node : t.conflicts)
+      for (const auto& edge : node->detections)
+        costs.push_back(edge.node->factor.detection());
+  }
+
+  bool conflicting_detection_costs_converged(const timestep_type& t, const std::vector<cost>& costs) const
+  {
+    cost change = 0;
+    auto it = costs.cbegin();
+    for (const auto* node : t.conflicts)
+      for (const auto& edge : node->detections)
+        change += std::abs(edge.node->factor.detection() - *it++);
+    return change <= conflict_tolerance_ * costs.size();
+  }
+
+  // Greedy tiling with the given number of bytes per tile. Returns no tiles
+  // if a tile would be shorter than `min_tile_size`.
+  std::vector<std::pair<index, index>> tiles(const size_t budget) const
+  {
+    const auto& timesteps = graph_.timesteps();
+    std::vector<std::pair<index, index>> result;
+    index first = 0;
+    while (first < timesteps.size()) {
+      index last = first;
+      size_t bytes = 0;
+      while (last < timesteps.size() && bytes + timesteps[last].memory_footprint() <= budget)
+        bytes += timesteps[last++].memory_footprint();
+
+      if (last < timesteps.size() && last - first < min_tile_size)
+        return {};
+
+      result.emplace_back(first, last);
+      if (last == timesteps.size())
+        break;
+      first = last - (last - first) / 4;
+    }
+    return result;
+  }
+
+  // Start of the window of `size` consecutive timesteps whose local gaps
+  // have the largest sum.
+  index largest_gap_window(const index size) const
+  {
+    std::vector<cost> lower_bounds, upper_bounds;
+    bounds_by_timestep(lower_bounds, upper_bounds);
+
+    const index number_of_timesteps = lower_bounds.size();
+    index best_first = 0;
+    cost best_gap = -std::numeric_limits<cost>::infinity();
+    for (index first = 0; first + size <= number_of_timesteps; ++first) {
+      cost gap = 0;
+      for (index t = first; t < first + size; ++t)
+        gap += upper_bounds[t] - lower_bounds[t];
+      if (gap > best_gap) {
+        best_gap = gap;
+        best_first = first;
+      }
+    }
+    return best_first;
+  }
+
+  template<typename SHOULD_STOP>
+  void focus_on_gap(SHOULD_STOP should_stop)
+  {
+    auto span = tracer_.trace("gap_focus");
+    const index size = std::min<index>(focus_window_size_, graph_.timesteps().size());
+    if (size == 0)
+      return;
+
+    const index first = largest_gap_window(size);
+    for (int i = 0; i < focus_sweeps_ && !should_stop(); ++i) {
+      single_pass<true, false>(first, first + size);
+      single_pass<false, false>(first, first + size);
+    }
+  }
+
+  void fix_primals(const index first, const index last)
+  {
+    const auto& timesteps = graph_.timesteps();
+    for (index t = first; t < last; ++t)
+      for (const auto* node : timesteps[t].detections)
+        node->factor.fix_primal();
+  }
+
+  // Rounding of the window [first, last) while the timesteps before `first`
+  // are committed. The outgoing decisions of the last committed timestep are
+  // rounded again, either implicitly via the incoming decisions of the
+  // window (forward) or explicitly after the window (backward).
+  template<bool forward>
+  void round_window(const index first, const index last)
+  {
+    const auto& timesteps = graph_.timesteps();
+    for_each_node([](const auto* node) { node->factor.reset_primal(); }, first, last);
+    if (first > 0)
+      for (const auto* node : timesteps[first-1].detections)
+        node->factor.primal().reset_outgoing();
+
+    if constexpr (forward) {
+      for (index t = first; t < last; ++t)
+        single_step<true, true>(timesteps[t]);
+    } else {
+      for (index t = last; t-- > first; )
+        single_step<false, true>(timesteps[t]);
+
+      if (first > 0) {
+        for (const auto* node : timesteps[first-1].detections) {
+          const auto& p = node->factor.primal();
+          if (!p.is_detection_on() || p.is_outgoing_set())
+            continue;
+
+          std::array<bool, max_number_of_detection_edges + 1> possible;
+          transition_messages::get_primal_possibilities<false>(node, possible);
+          node->factor.template round_primal<false>(possible);
+          transition_messages::propagate_primal<true>(node);
+        }
+      }
+    }
+
+    fix_primals(first > 0 ? first - 1 : first, last);
+  }
+
+  template<typename SNAPSHOT>
+  void resize_primal_storage(SNAPSHOT& snapshot, const index first, const index last) const
+  {
+    const auto& timesteps = graph_.timesteps();
+    size_t detections = 0, conflicts = 0;
+    for (index t = first; t < last; ++t) {
+      detections += timesteps[t].detections.size();
+      conflicts += timesteps[t].conflicts.size();
+    }
+    snapshot.detections.resize(detections);
+    snapshot.conflicts.resize(conflicts);
+  }
+
+  template<typename SNAPSHOT, typename FUNCTOR>
+  void visit_primal_storage(SNAPSHOT& snapshot, FUNCTOR functor) const
+  {
+    visit_primal_storage(snapshot, functor, 0, graph_.timesteps().size());
+  }
+
+  template<typename SNAPSHOT, typename FUNCTOR>
+  void visit_primal_storage(SNAPSHOT& snapshot, FUNCTOR functor, const index first, const index last) const
+  {
+    auto it_detection = snapshot.detections.begin();
+    auto it_conflict = snapshot.conflicts.begin();
+    const auto& timesteps = graph_.timesteps();
+    for (index t = first; t < last; ++t) {
+      if (sweep_observer_)
+        sweep_observer_(t, true);
+
+      for (const auto* node : timesteps[t].detections) {
+        assert(it_detection != snapshot.detections.end());
+        functor(it_detection++, node->factor);
+      }
+      for (const auto* node : timesteps[t].conflicts) {
+        assert(it_conflict != snapshot.conflicts.end());
+        functor(it_conflict++, node->factor);
+      }
+    }
+    assert(it_detection == snapshot.detections.end());
+    assert(it_conflict == snapshot.conflicts.end());
+  }
+
+  // Double buffering: The primals are copied into a spare snapshot without
+  // holding the lock, afterwards only the pointers are swapped. The previous
+  // snapshot is reused next time unless a reader still holds on to it.
+  void publish_best_primals(cost upper_bound)
+  {
+    auto s = std::move(spare_primals_);
+    if (!s)
+      s = std::make_shared<primal_snapshot>();
+
+    resize_primal_storage(*s, 0, graph_.timesteps().size());
+    s->upper_bound = upper_bound;
+    visit_primal_storage(*s, [](auto it, const auto& f) { *it = f.primal(); });
+
+    {
+      std::lock_guard<std::mutex> lock(snapshot_mutex_);
+      std::swap(best_primals_, s);
+    }
+
+    if (s && s.use_count() == 1)
+      spare_primals_ = std::move(s);
+  }
+
+  void publish_lower_bound(cost lower_bound)
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    published_lower_bound_ = lower_bound;
+    published_iterations_ = iterations_;
+  }
+
   template<typename FUNCTOR>
   void for_each_node(FUNCTOR f) const
   {
-    for (const auto& timestep : graph_.timesteps()) {
-      for (const auto* node : timestep.detections)
+    for_each_node(f, 0, graph_.timesteps().size());
+  }
+
+  template<typename FUNCTOR>
+  void for_each_node(FUNCTOR f, const index first, const index last) const
+  {
+    const auto& timesteps = graph_.timesteps();
+    for (index t = first; t < last; ++t) {
+      if (sweep_observer_)
+        sweep_observer_(t, true);
+
+      for (const auto* node : timesteps[t].detections)
         f(node);
 
-      for (const auto* node : timestep.conflicts)
+      for (const auto* node : timesteps[t].conflicts)
         f(node);
     }
   }
@@ -200,15 +1466,37 @@ protected:
   template<bool forward, bool rounding>
   void single_step(const timestep_type& t)
   {
-    for (int i = 0; i < 5; ++i) {
-      for (const auto* node : t.conflicts)
-        conflict_messages::send_messages_to_conflict(node);
+    const index timestep_idx = &t - graph_.timesteps().data();
+    auto span = tracer_.trace(forward ? "forward_step" : "backward_step", timestep_idx);
+    instrumentation_.set_timestep(timestep_idx);
 
-      for (const auto* node : t.conflicts)
-        conflict_messages::send_messages_to_detection(node);
+    {
+      auto probe = instrumentation_.measure(phase::conflict_messages);
+      const bool adaptive = conflict_max_rounds_ > conflict_min_rounds_ && !t.conflicts.empty();
+      thread_local std::vector<cost> scratch; // steps may run in parallel
+      int rounds = 0;
+      while (rounds < conflict_max_rounds_) {
+        const bool check = adaptive && rounds + 1 >= conflict_min_rounds_;
+        if (check)
+          store_conflicting_detection_costs(t, scratch);
+
+        for (const auto* node : t.conflicts)
+          conflict_messages::send_messages_to_conflict(node);
+
+        for (const auto* node : t.conflicts)
+          conflict_messages::send_messages_to_detection(node);
+
+        ++rounds;
+        if (check && conflicting_detection_costs_converged(t, scratch))
+          break;
+      }
+      instrumentation_.count(counter::conflict_messages, 2 * rounds * t.conflicts.size());
     }
 
     if constexpr (rounding) {
+      auto span = tracer_.trace("rounding", timestep_idx);
+      auto probe = instrumentation_.measure(phase::rounding);
+
       // We drain the conflict factors here.
       // BIG FAT WARNING: This operation here is not a real reparametrization,
       // because we do only change the values of the detection factors. It is
@@ -219,50 +1507,74 @@ protected:
         for (size_t i = 0; i < node->detections.size(); ++i)
           node->detections[i].node->factor.repam_detection(node->factor.get(i));
 
-      conflict_subsolver<graph_type> subsolver(this->gurobi_env_);
-      for (const auto* node : t.detections)
-        subsolver.add_detection(node);
-      for (const auto* node : t.conflicts)
-        subsolver.add_conflict(node);
+      if (t.conflicts.empty()) {
+        // Without any constraints the subsolver would just switch on every
+        // detection with negative costs, so we do not build a model.
+        for (const auto* node : t.detections)
+          if (node->factor.min_detection() >= 0)
+            node->factor.primal().set_detection_off();
+      } else {
+        auto span = tracer_.trace("subsolver", timestep_idx);
+        auto probe = instrumentation_.measure(phase::subsolver);
+        conflict_subsolver<graph_type> subsolver(this->gurobi_env_);
+        for (const auto* node : t.detections)
+          subsolver.add_detection(node);
+        for (const auto* node : t.conflicts)
+          subsolver.add_conflict(node);
 
-      subsolver.optimize();
-      for (const auto* node : t.detections)
-        if (!subsolver.assignment(node))
-          node->factor.primal().set_detection_off();
+        subsolver.optimize();
+        for (const auto* node : t.detections)
+          if (!subsolver.assignment(node))
+            node->factor.primal().set_detection_off();
+        instrumentation_.count(counter::subsolver_calls);
+      }
 
       // FIXME: Pre-allocate scratch space and do not resort to dynamic
       // memory allocation.
       std::vector<typename graph_type::detection_node_type*> sorted_detections(t.detections.cbegin(), t.detections.cend());
-      std::sort(sorted_detections.begin(), sorted_detections.end(),
-        [](const auto* a, const auto* b) {
-          const auto va = a->factor.min_detection();
-          const auto vb = b->factor.min_detection();
-          return va < vb;
-        });
+      {
+        auto probe = instrumentation_.measure(phase::rounding_sort);
+        std::sort(sorted_detections.begin(), sorted_detections.end(),
+          [](const auto* a, const auto* b) {
+            const auto va = a->factor.min_detection();
+            const auto vb = b->factor.min_detection();
+            return va < vb;
+          });
+      }
 
-      for (const auto* node : sorted_detections) {
-        // Checks that all messages are either consistent or unknown but not
-        // inconsitent. This property must be invariant during rounding, so we
-        // verify that it is the case.
-        auto check_messages = [&]() {
+      // Timesteps without divisions use the code paths that do not check for
+      // them.
+      auto round_detections = [&](auto divisions) {
+        constexpr bool has_divisions = decltype(divisions)::value;
+        for (const auto* node : sorted_detections) {
+          // Checks that all messages are either consistent or unknown but not
+          // inconsitent. This property must be invariant during rounding, so
+          // we verify that it is the case.
+          auto check_messages = [&]() {
 #ifndef NDEBUG
-          assert(transition_messages::check_primal_consistency(node).is_not_inconsistent());
-          for (const auto& edge : node->conflicts)
-            assert(conflict_messages::check_primal_consistency(edge.node).is_not_inconsistent());
+            assert(transition_messages::check_primal_consistency(node).is_not_inconsistent());
+            for (const auto& edge : node->conflicts)
+              assert(conflict_messages::check_primal_consistency(edge.node).is_not_inconsistent());
 #endif
-        };
+          };
 
-        std::array<bool, max_number_of_detection_edges + 1> possible;
-        transition_messages::get_primal_possibilities<forward>(node, possible);
+          std::array<bool, max_number_of_detection_edges + 1> possible;
+          transition_messages::get_primal_possibilities<forward, has_divisions>(node, possible);
 
-        node->factor.template round_primal<forward>(possible); check_messages();
-        transition_messages::propagate_primal<!forward>(node); check_messages();
-        for (const auto& edge : node->conflicts) {
-          conflict_messages::propagate_primal_to_conflict(edge.node); check_messages();
-          conflict_messages::propagate_primal_to_detections(edge.node); check_messages();
+          node->factor.template round_primal<forward>(possible); check_messages();
+          transition_messages::propagate_primal<!forward, has_divisions>(node); check_messages();
+          for (const auto& edge : node->conflicts) {
+            conflict_messages::propagate_primal_to_conflict(edge.node); check_messages();
+            conflict_messages::propagate_primal_to_detections(edge.node); check_messages();
+          }
         }
-      }
+      };
 
+      if (t.has_divisions())
+        round_detections(std::true_type());
+      else
+        round_detections(std::false_type());
+      instrumentation_.count(counter::nodes_rounded, t.detections.size());
       // Here we restore the property of a reparametrization again. We execute
       // the inverse cost manipulation operation on all detection factors.
       for (const auto* node : t.conflicts)
@@ -270,13 +1582,71 @@ protected:
           node->detections[i].node->factor.repam_detection(-node->factor.get(i));
     }
 
-    for (const auto* node : t.detections)
-      transition_messages::send_messages<forward>(node);
+    {
+      auto probe = instrumentation_.measure(phase::transition_messages);
+      transition_messages::send_messages<forward>(t, transition_weight_);
+      instrumentation_.count(counter::transition_messages, t.detections.size());
+    }
+    instrumentation_.set_timestep(instrumentation::no_timestep);
   }
 
   graph_type graph_;
   int iterations_;
   cost constant_;
+  int batch_size_;
+  bool verbose_;
+  bool handle_signals_;
+  std::atomic<bool> cancel_requested_;
+  std::function<bool(const run_progress&)> progress_callback_;
+  std::function<void(index, bool)> sweep_observer_;
+  instrumentation instrumentation_;
+  trace_recorder tracer_;
+  std::string trace_filename_;
+
+  mutable std::mutex snapshot_mutex_;
+  std::shared_ptr<primal_snapshot> best_primals_;
+  std::shared_ptr<primal_snapshot> spare_primals_;
+  cost published_lower_bound_;
+  int published_iterations_;
+
+  int conflict_min_rounds_;
+  int conflict_max_rounds_;
+  cost conflict_tolerance_;
+
+  double initial_transition_weight_;
+  int transition_ramp_iterations_;
+  double transition_weight_;
+
+  int extrapolation_interval_;
+  double extrapolation_beta_;
+  double extrapolation_step_;
+  int extrapolation_countdown_;
+  int extrapolations_accepted_;
+  int extrapolations_rejected_;
+  std::vector<cost> extrapolation_previous_;
+  std::vector<cost> extrapolation_current_;
+
+  std::unique_ptr<thread_pool> pool_;
+
+  int tile_sweeps_;
+  size_t tile_cache_bytes_;
+
+  index focus_window_size_;
+  int focus_sweeps_;
+
+  index window_size_;
+  index committed_timesteps_;
+
+  // Timesteps [dirty_first_, dirty_last_) were touched by incremental
+  // updates since the last `resolve`.
+  index dirty_first_;
+  index dirty_last_;
+
+  std::string checkpoint_filename_;
+  double checkpoint_interval_;
+  std::shared_ptr<solver_state> checkpoint_state_;
+  std::future<bool> checkpoint_writer_;
+
   GRBEnv gurobi_env_;
 };
 
@@ -5,6 +5,11 @@ namespace ct {
 
 struct transition_messages {
 
+  // Highest degree for which `send_messages` of a whole timestep uses a
+  // kernel that is specialized for the number of transitions. Nodes with
+  // more transitions are rare and handled by the generic code.
+  static constexpr index max_specialized_degree = 8;
+
   template<bool to_right, typename DETECTION_NODE>
   static void send_messages(const DETECTION_NODE* node, double weight=1.0)
   {
@@ -13,16 +18,6 @@ struct transition_messages {
     auto& here = node->factor;
     using detection_type = typename DETECTION_NODE::detection_type;
 
-#ifndef NDEBUG
-    auto local_lower_bound = [&](const auto& edge) {
-      cost result = here.lower_bound();
-      result += edge.node1->factor.lower_bound();
-      if (edge.is_division() && to_right)
-        result += edge.node2->factor.lower_bound();
-      return result;
-    };
-#endif
-
     const auto min_other_side   = to_right ? here.min_incoming()
                                            : here.min_outgoing();
     const auto& costs_this_side = to_right ? here.outgoing_
@@ -45,7 +40,7 @@ struct transition_messages {
                                         : &detection_type::repam_outgoing;
 
 #ifndef NDEBUG
-      const cost lb_before = local_lower_bound(edge);
+      const cost lb_before = local_lower_bound<to_right>(here, edge);
 #endif
       auto msg = (constant + slot_cost - set_to) * weight;
       (here.*repam_this)(slot, -msg);
@@ -57,13 +52,124 @@ struct transition_messages {
       }
 
 #ifndef NDEBUG
-      const auto lb_after = local_lower_bound(edge);
+      const auto lb_after = local_lower_bound<to_right>(here, edge);
       assert(lb_before <= lb_after + epsilon);
 #endif
     });
   }
 
-  template<bool to_right, typename DETECTION_NODE>
+  // Same as `send_messages` above, but for a node with exactly `degree`
+  // transitions on the sending side and no divisions among them (divisions
+  // only matter when sending to the right). With the degree known at compile
+  // time the loops are fully unrolled and the least two values are computed
+  // branch-free, which yields exactly the same messages.
+  template<bool to_right, index degree, typename DETECTION_NODE>
+  static void send_messages_fixed(const DETECTION_NODE* node)
+  {
+    static_assert(degree > 0 && degree <= max_specialized_degree);
+    auto& here = node->factor;
+    const auto& edges = node->template transitions<to_right>();
+    assert(edges.size() == degree);
+
+    const cost* costs_this_side = to_right ? here.outgoing_.data()
+                                           : here.incoming_.data();
+    const auto min_other_side   = to_right ? here.min_incoming()
+                                           : here.min_outgoing();
+    const auto constant = here.detection() + min_other_side;
+
+    cost first_minimum = std::numeric_limits<cost>::infinity();
+    cost second_minimum = std::numeric_limits<cost>::infinity();
+    for (index slot = 0; slot < degree; ++slot) {
+      second_minimum = std::min(second_minimum, std::max(first_minimum, costs_this_side[slot]));
+      first_minimum = std::min(first_minimum, costs_this_side[slot]);
+    }
+
+    const auto real_second_minimum = std::min(second_minimum, costs_this_side[degree]);
+    const auto set_to = std::min(constant + (first_minimum + real_second_minimum) * 0.5, 0.0);
+
+    for (index slot = 0; slot < degree; ++slot) {
+      const auto& edge = edges[slot];
+      assert(!to_right || !edge.is_division());
+#ifndef NDEBUG
+      const cost lb_before = local_lower_bound<to_right>(here, edge);
+#endif
+      const auto msg = constant + costs_this_side[slot] - set_to;
+      if constexpr (to_right) {
+        here.repam_outgoing(slot, -msg);
+        edge.node1->factor.repam_incoming(edge.slot1, msg);
+      } else {
+        here.repam_incoming(slot, -msg);
+        edge.node1->factor.repam_outgoing(edge.slot1, msg);
+      }
+#ifndef NDEBUG
+      assert(lb_before <= local_lower_bound<to_right>(here, edge) + epsilon);
+#endif
+    }
+  }
+
+  // Sends the messages of all detections of a timestep. The detections are
+  // processed group by group (see `degree_groups`), so that the
+  // kernel is only selected once per group. Every slot of the neighboring
+  // timestep receives exactly one message, except for divisions sent to the
+  // left where both children update the outgoing slot of the parent. Hence
+  // the order of the nodes only changes the result up to floating-point
+  // summation order. Damped messages (`weight` < 1) always use the generic
+  // code.
+  template<bool to_right, typename TIMESTEP>
+  static void send_messages(const TIMESTEP& t, double weight=1.0)
+  {
+    const auto& groups = t.template groups_by_degree<to_right>();
+    for (const auto& group : groups.groups) {
+      const auto* begin = groups.nodes.data() + group.begin;
+      const auto* end = groups.nodes.data() + group.end;
+
+      if (group.degree == 0) {
+        // Nothing to send, the factor would not change.
+      } else if (group.division || group.degree > max_specialized_degree || weight != 1.0) {
+        for (auto it = begin; it != end; ++it)
+          send_messages<to_right>(*it, weight);
+      } else {
+        dispatch_degree(group.degree, [&](auto degree) {
+          for (auto it = begin; it != end; ++it)
+            send_messages_fixed<to_right, decltype(degree)::value>(*it);
+        });
+      }
+    }
+  }
+
+  // Redistributes the cost of every outgoing transition and division of
+  // `node` among all attached detections, such that their min-marginals of
+  // the edge agree. This is the optimal update for a single edge, so the
+  // lower bound never decreases. Used to initialize the reparametrization.
+  template<typename DETECTION_NODE>
+  static void average_min_marginals(const DETECTION_NODE* node)
+  {
+    auto& here = node->factor;
+    node->template traverse_transitions<true>([&](auto& edge, auto slot) {
+#ifndef NDEBUG
+      const cost lb_before = local_lower_bound<true>(here, edge);
+#endif
+      const auto marginal_here = min_marginal<true>(here, slot);
+      const auto marginal_1 = min_marginal<false>(edge.node1->factor, edge.slot1);
+      if (edge.is_division()) {
+        const auto marginal_2 = min_marginal<false>(edge.node2->factor, edge.slot2);
+        const auto mean = (marginal_here + marginal_1 + marginal_2) / 3;
+        here.repam_outgoing(slot, mean - marginal_here);
+        edge.node1->factor.repam_incoming(edge.slot1, mean - marginal_1);
+        edge.node2->factor.repam_incoming(edge.slot2, mean - marginal_2);
+      } else {
+        const auto mean = 0.5 * (marginal_here + marginal_1);
+        here.repam_outgoing(slot, mean - marginal_here);
+        edge.node1->factor.repam_incoming(edge.slot1, mean - marginal_1);
+      }
+#ifndef NDEBUG
+      const auto lb_after = local_lower_bound<true>(here, edge);
+      assert(lb_before <= lb_after + epsilon);
+#endif
+    });
+  }
+
+  template<bool to_right, bool divisions = true, typename DETECTION_NODE>
   static consistency check_primal_consistency_impl(const DETECTION_NODE* node, index slot)
   {
     consistency result;
@@ -97,7 +203,7 @@ struct transition_messages {
     //
     // For `to_right == false` the second connected factor is a factor of
     // the very same time step (so the "sibling" of `node`).
-    if (edge.is_division()) {
+    if (is_division<divisions>(edge)) {
       const auto& there2 = edge.node2->factor;
       if (there2.primal().is_incoming_set()) {
         if ((p == slot) != (there2.primal().incoming() == edge.slot2))
@@ -147,7 +253,7 @@ struct transition_messages {
     return result;
   }
 
-  template<bool to_right, typename DETECTION_NODE>
+  template<bool to_right, bool divisions = true, typename DETECTION_NODE>
   static void propagate_primal(const DETECTION_NODE* node)
   {
     const auto& here = node->factor;
@@ -166,7 +272,7 @@ struct transition_messages {
           conflict_messages::template propagate_primal_to_detections(conflict_edge.node);
         }
 
-        if (edge.is_division()) {
+        if (is_division<divisions>(edge)) {
           edge.node2->factor.primal().set_incoming(edge.slot2);
           for (const auto& conflict_edge : edge.node2->conflicts) {
             conflict_messages::template propagate_primal_to_conflict(conflict_edge.node);
@@ -185,7 +291,7 @@ struct transition_messages {
           conflict_messages::template propagate_primal_to_detections(conflict_edge.node);
         }
 
-        if (edge.is_division()) {
+        if (is_division<divisions>(edge)) {
           edge.node2->factor.primal().set_incoming(edge.slot2);
           for (const auto& conflict_edge : edge.node2->conflicts) {
             conflict_messages::template propagate_primal_to_conflict(conflict_edge.node);
@@ -196,7 +302,7 @@ struct transition_messages {
     }
   }
 
-  template<bool from_left, typename DETECTION_NODE, typename CONTAINER>
+  template<bool from_left, bool divisions = true, typename DETECTION_NODE, typename CONTAINER>
   static void get_primal_possibilities(const DETECTION_NODE* node, CONTAINER& out)
   {
     out.fill(true);
@@ -233,7 +339,7 @@ struct transition_messages {
       };
 
       helper(edge.node1->factor, edge.slot1, get_primal);
-      if (edge.is_division()) {
+      if (is_division<divisions>(edge)) {
         if constexpr (from_left)
           helper(edge.node2->factor, edge.slot2, get_primal2);
         else
@@ -245,6 +351,50 @@ struct transition_messages {
     assert(std::find(out.cbegin(), out.cend(), true) != out.cend());
   }
 
+protected:
+  // With `divisions == false` the caller guarantees that none of the edges is
+  // a division (see `timestep::has_divisions`), so the check vanishes at
+  // compile time.
+  template<bool divisions, typename EDGE>
+  static bool is_division(const EDGE& edge)
+  {
+    assert(divisions || !edge.is_division());
+    return divisions && edge.is_division();
+  }
+
+  // Difference between the best cost of `factor` with the transition in
+  // `slot` (on the outgoing or incoming side) and the best cost without it.
+  template<bool outgoing, typename DETECTION_FACTOR>
+  static cost min_marginal(const DETECTION_FACTOR& factor, const index slot)
+  {
+    const auto& side = outgoing ? factor.outgoing_ : factor.incoming_;
+    const auto constant = factor.detection() + (outgoing ? factor.min_incoming() : factor.min_outgoing());
+    const auto [first_minimum, second_minimum] = least_two_values(side.begin(), side.end());
+    const auto min_without = side[slot] == first_minimum ? second_minimum : first_minimum;
+    return constant + side[slot] - std::min(constant + min_without, 0.0);
+  }
+
+  template<bool to_right, typename DETECTION_FACTOR, typename EDGE>
+  static cost local_lower_bound(const DETECTION_FACTOR& here, const EDGE& edge)
+  {
+    cost result = here.lower_bound();
+    result += edge.node1->factor.lower_bound();
+    if (edge.is_division() && to_right)
+      result += edge.node2->factor.lower_bound();
+    return result;
+  }
+
+  template<index degree = 1, typename FUNCTOR>
+  static void dispatch_degree(index d, FUNCTOR f)
+  {
+    if constexpr (degree <= max_specialized_degree) {
+      if (d == degree)
+        f(std::integral_constant<index, degree>());
+      else
+        dispatch_degree<degree + 1>(d, f);
+    }
+  }
+
 };
 
 }
@@ -9,14 +9,66 @@ using conflict_type = ct::conflict_node<allocator_type>;
 
 struct ct_tracker_t {
   ct::memory_block memory;
+  ct::memory_block cost_memory;
   allocator_type allocator;
+  allocator_type cost_allocator;
   tracker_type tracker;
+  std::unique_ptr<ct::residency_manager<graph_type>> residency;
 
-  ct_tracker_t()
-  : memory()
+  // An empty directory means in-memory storage, otherwise both arenas are
+  // backed by temporary files in this directory.
+  ct_tracker_t(const std::string& directory = std::string(), int lookahead = 2)
+  : memory(directory)
+  , cost_memory(directory)
   , allocator(memory)
-  , tracker(allocator)
-  { }
+  , cost_allocator(cost_memory)
+  , tracker(allocator, cost_allocator)
+  {
+    if (!directory.empty()) {
+      residency = std::make_unique<ct::residency_manager<graph_type>>(
+        tracker.get_graph(), std::vector<const ct::memory_block*>{&memory, &cost_memory}, lookahead);
+      tracker.set_sweep_observer([r = residency.get()](ct::index timestep, bool forward) { (*r)(timestep, forward); });
+    }
+  }
+
+  void reset()
+  {
+    tracker.reset();
+    memory.reset();
+    cost_memory.reset();
+    if (residency)
+      residency->invalidate();
+  }
+
+  ct::cost* costs() const { return reinterpret_cast<ct::cost*>(cost_memory.data()); }
+  long long offset(const ct::cost* ptr) const { return ptr - costs(); }
+};
+
+// Trackers that are ready for reuse. Acquiring never blocks, the pool grows
+// if all trackers are in use.
+struct ct_tracker_pool_t {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ct_tracker_t>> idle;
+
+  ct_tracker_t* acquire()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!idle.empty()) {
+        auto* t = idle.back().release();
+        idle.pop_back();
+        return t;
+      }
+    }
+    return new ct_tracker_t;
+  }
+
+  void release(ct_tracker_t* t)
+  {
+    t->reset();
+    std::lock_guard<std::mutex> lock(mutex);
+    idle.emplace_back(t);
+  }
 };
 
 inline auto* to_graph(graph_type* g) { return reinterpret_cast<ct_graph*>(g); }
@@ -28,6 +80,40 @@ inline auto* from_detection(ct_detection* d) { return reinterpret_cast<detection
 inline auto* to_conflict(conflict_type* d) { return reinterpret_cast<ct_conflict*>(d); }
 inline auto* from_conflict(ct_conflict* d) { return reinterpret_cast<conflict_type*>(d); }
 
+inline void to_c_instrumentation(const ct::phase_statistics& s, int iterations, ct_instrumentation* result)
+{
+  using ct::phase;
+  using ct::counter;
+  result->iterations = iterations;
+  result->seconds_conflict_messages = s[phase::conflict_messages];
+  result->seconds_transition_messages = s[phase::transition_messages];
+  result->seconds_subsolver = s[phase::subsolver];
+  result->seconds_rounding_sort = s[phase::rounding_sort];
+  result->seconds_rounding = s[phase::rounding];
+  result->seconds_evaluate_primal = s[phase::evaluate_primal];
+  result->seconds_lower_bound = s[phase::lower_bound];
+  result->seconds_primal_copy = s[phase::primal_copy];
+  result->transition_messages = s[counter::transition_messages];
+  result->conflict_messages = s[counter::conflict_messages];
+  result->subsolver_calls = s[counter::subsolver_calls];
+  result->nodes_rounded = s[counter::nodes_rounded];
+  result->candidates_evaluated = s[counter::candidates_evaluated];
+
+  auto to_c_hardware = [&](std::initializer_list<phase> phases, ct_hardware_counters* hardware) {
+    ct::hardware_counts sum = {};
+    for (auto p : phases)
+      for (int i = 0; i < ct::number_of_hardware_events; ++i)
+        sum[i] += s.hardware[static_cast<int>(p)][i];
+    hardware->cycles = sum[static_cast<int>(ct::hardware_event::cycles)];
+    hardware->instructions = sum[static_cast<int>(ct::hardware_event::instructions)];
+    hardware->llc_misses = sum[static_cast<int>(ct::hardware_event::llc_misses)];
+    hardware->branch_misses = sum[static_cast<int>(ct::hardware_event::branch_misses)];
+  };
+  to_c_hardware({phase::conflict_messages}, &result->hardware_conflict_messages);
+  to_c_hardware({phase::transition_messages}, &result->hardware_transition_messages);
+  to_c_hardware({phase::rounding, phase::rounding_sort, phase::subsolver}, &result->hardware_rounding);
+}
+
 extern "C" {
 
 //
@@ -35,8 +121,36 @@ extern "C" {
 //
 
 ct_tracker* ct_tracker_create() { return new ct_tracker; }
+
+ct_tracker* ct_tracker_create_file_backed(const char* directory, int lookahead)
+{
+  try {
+    return new ct_tracker(directory, lookahead);
+  } catch (const std::exception& e) {
+    std::cerr << "[ct] " << e.what() << std::endl;
+    return nullptr;
+  }
+}
 void ct_tracker_destroy(ct_tracker* t) { delete t; }
-void ct_tracker_finalize(ct_tracker* t) { t->memory.finalize(); }
+void ct_tracker_finalize(ct_tracker* t)
+{
+  t->memory.finalize();
+  t->cost_memory.finalize();
+}
+
+void ct_tracker_reset(ct_tracker* t) { t->reset(); }
+
+ct_tracker_pool* ct_tracker_pool_create(int size)
+{
+  auto* pool = new ct_tracker_pool;
+  for (int i = 0; i < size; ++i)
+    pool->idle.emplace_back(new ct_tracker);
+  return pool;
+}
+
+void ct_tracker_pool_destroy(ct_tracker_pool* pool) { delete pool; }
+ct_tracker* ct_tracker_pool_acquire(ct_tracker_pool* pool) { return pool->acquire(); }
+void ct_tracker_pool_release(ct_tracker_pool* pool, ct_tracker* t) { pool->release(t); }
 
 ct_graph* ct_tracker_get_graph(ct_tracker* t) { return to_graph(&t->tracker.get_graph()); }
 
@@ -73,18 +187,310 @@ void ct_graph_add_conflict_link(ct_graph* g, int timestep, int conflict, int con
   from_graph(g)->add_conflict_link(timestep, conflict, conflict_slot, detection, detection_slot);
 }
 
+void ct_graph_set_transition_cost(ct_graph* g, int timestep, int detection, int slot, double c)
+{
+  from_graph(g)->set_transition_cost(timestep, detection, slot, c);
+}
+
+void ct_graph_resize_outgoing(ct_graph* g, int timestep, int detection, int number_of_outgoing)
+{
+  from_graph(g)->resize_outgoing(timestep, detection, number_of_outgoing);
+}
+
 ct_conflict* ct_graph_get_conflict(ct_graph* g, int timestep, int conflict)
 {
   auto* e = from_graph(g)->conflict(timestep, conflict);
   return to_conflict(e);
 }
 
+int ct_graph_get_number_of_detections(ct_graph* g) { return from_graph(g)->number_of_detections(); }
+int ct_graph_get_number_of_transitions(ct_graph* g) { return from_graph(g)->number_of_transitions(); }
+int ct_graph_get_number_of_divisions(ct_graph* g) { return from_graph(g)->number_of_divisions(); }
+int ct_graph_get_number_of_conflicts(ct_graph* g) { return from_graph(g)->number_of_conflicts(); }
+int ct_graph_get_number_of_timesteps(ct_graph* g) { return from_graph(g)->timesteps().size(); }
+
 void ct_tracker_run(ct_tracker* t, int max_iterations) { t->tracker.run(max_iterations); }
-double ct_tracker_lower_bound(ct_tracker* t) { return t->tracker.lower_bound(); }
+void ct_tracker_set_batch_size(ct_tracker* t, int batch_size) { t->tracker.set_batch_size(batch_size); }
+void ct_tracker_set_verbose(ct_tracker* t, int verbose) { t->tracker.set_verbose(verbose != 0); }
+void ct_tracker_cancel(ct_tracker* t) { t->tracker.cancel(); }
+void ct_tracker_set_handle_signals(ct_tracker* t, int enabled) { t->tracker.set_handle_signals(enabled != 0); }
+
+void ct_tracker_set_progress_callback(ct_tracker* t, ct_progress_callback callback, void* user_data)
+{
+  if (callback == nullptr) {
+    t->tracker.set_progress_callback(nullptr);
+    return;
+  }
+
+  t->tracker.set_progress_callback([callback, user_data](const ct::run_progress& p) {
+    ct_progress progress;
+    progress.iterations = p.iterations;
+    progress.lower_bound = p.lower_bound;
+    progress.upper_bound = p.upper_bound;
+    progress.gap = p.gap;
+    progress.seconds = p.seconds;
+    progress.seconds_messages = p.seconds_messages;
+    progress.seconds_rounding = p.seconds_rounding;
+    progress.seconds_bounds = p.seconds_bounds;
+    return callback(&progress, user_data) != 0;
+  });
+}
+
+void ct_tracker_set_instrumentation(ct_tracker* t, int enabled) { t->tracker.set_instrumentation(enabled != 0); }
+int ct_tracker_set_hardware_counters(ct_tracker* t, int enabled) { return t->tracker.set_hardware_counters(enabled != 0) ? 0 : -1; }
+int ct_tracker_get_instrumentation_number_of_batches(ct_tracker* t) { return t->tracker.get_instrumentation().batches().size(); }
+
+int ct_tracker_get_instrumentation(ct_tracker* t, int batch, ct_instrumentation* result)
+{
+  const auto& instrumentation = t->tracker.get_instrumentation();
+  const auto& batches = instrumentation.batches();
+  if (batch == -1) {
+    to_c_instrumentation(instrumentation.total(), batches.empty() ? 0 : batches.back().iterations, result);
+    return 0;
+  }
+
+  if (batch < 0 || static_cast<size_t>(batch) >= batches.size())
+    return -1;
+  to_c_instrumentation(batches[batch], batches[batch].iterations, result);
+  return 0;
+}
+
+int ct_tracker_get_timestep_instrumentation(ct_tracker* t, int timestep, ct_instrumentation* result)
+{
+  const auto& timesteps = t->tracker.get_instrumentation().timesteps();
+  if (timestep < 0 || static_cast<size_t>(timestep) >= timesteps.size())
+    return -1;
+  to_c_instrumentation(timesteps[timestep], 0, result);
+  return 0;
+}
+
+int ct_tracker_write_instrumentation(ct_tracker* t, const char* filename)
+{
+  return t->tracker.get_instrumentation().write_json(filename) ? 0 : -1;
+}
+
+void ct_tracker_set_trace(ct_tracker* t, const char* filename, int events_per_thread)
+{
+  const size_t capacity = events_per_thread > 0 ? events_per_thread : ct::trace_recorder::default_capacity;
+  t->tracker.set_trace(filename != nullptr ? filename : "", capacity);
+}
+
+int ct_tracker_write_trace(ct_tracker* t, const char* filename)
+{
+  return t->tracker.get_trace().write_json(filename) ? 0 : -1;
+}
+
+void ct_tracker_set_window_size(ct_tracker* t, int window_size) { t->tracker.set_window_size(window_size); }
+void ct_tracker_run_window(ct_tracker* t, int max_iterations, double max_seconds) { t->tracker.run_window(max_iterations, max_seconds); }
+void ct_tracker_commit_window(ct_tracker* t) { t->tracker.commit_window(); }
+int ct_tracker_get_number_of_committed_timesteps(ct_tracker* t) { return t->tracker.number_of_committed_timesteps(); }
+
+void ct_tracker_add_detection_cost(ct_tracker* t, int timestep, int detection, double delta) { t->tracker.add_detection_cost(timestep, detection, delta); }
+void ct_tracker_add_appearance_cost(ct_tracker* t, int timestep, int detection, double delta) { t->tracker.add_appearance_cost(timestep, detection, delta); }
+void ct_tracker_add_disappearance_cost(ct_tracker* t, int timestep, int detection, double delta) { t->tracker.add_disappearance_cost(timestep, detection, delta); }
+void ct_tracker_add_transition_cost(ct_tracker* t, int timestep, int detection, int slot, double delta) { t->tracker.add_transition_cost(timestep, detection, slot, delta); }
+
+int ct_tracker_add_costs(ct_tracker* t, const double* detection_deltas, size_t detection_deltas_size, const double* appearance_deltas, size_t appearance_deltas_size, const double* disappearance_deltas, size_t disappearance_deltas_size, const double* transition_deltas, size_t transition_deltas_size, const double* division_deltas, size_t division_deltas_size)
+{
+  auto& tr = t->tracker;
+  const auto& g = tr.get_graph();
+  if (detection_deltas_size != g.number_of_detections() ||
+      appearance_deltas_size != g.number_of_detections() ||
+      disappearance_deltas_size != g.number_of_detections() ||
+      transition_deltas_size != g.number_of_transitions() ||
+      division_deltas_size != g.number_of_divisions())
+    return -1;
+
+  const auto& timesteps = g.timesteps();
+  for (ct::index timestep = 0; timestep < timesteps.size(); ++timestep) {
+    for (ct::index detection = 0; detection < timesteps[timestep].detections.size(); ++detection) {
+      if (*detection_deltas != 0)
+        tr.add_detection_cost(timestep, detection, *detection_deltas);
+      if (*appearance_deltas != 0)
+        tr.add_appearance_cost(timestep, detection, *appearance_deltas);
+      if (*disappearance_deltas != 0)
+        tr.add_disappearance_cost(timestep, detection, *disappearance_deltas);
+      ++detection_deltas; ++appearance_deltas; ++disappearance_deltas;
+    }
+  }
+
+  for (const auto& s : g.transitions()) {
+    if (*transition_deltas != 0)
+      tr.add_transition_cost(s.timestep, s.detection, s.slot, *transition_deltas);
+    ++transition_deltas;
+  }
+
+  for (const auto& s : g.divisions()) {
+    if (*division_deltas != 0)
+      tr.add_transition_cost(s.timestep, s.detection, s.slot, *division_deltas);
+    ++division_deltas;
+  }
+  return 0;
+}
+
+void ct_tracker_resolve(ct_tracker* t, int max_iterations, int margin) { t->tracker.resolve(max_iterations, margin); }
+
+int ct_tracker_save_state(ct_tracker* t, const char* filename) { return t->tracker.save_state(filename) ? 0 : -1; }
+int ct_tracker_load_state(ct_tracker* t, const char* filename) { return t->tracker.load_state(filename) ? 0 : -1; }
+void ct_tracker_set_checkpoint(ct_tracker* t, const char* filename, double interval_seconds) { t->tracker.set_checkpoint(filename != nullptr ? filename : "", interval_seconds); }
+void ct_tracker_initialize(ct_tracker* t) { t->tracker.initialize(); }
+int ct_tracker_save_reparametrization(ct_tracker* t, const char* filename) { return t->tracker.save_reparametrization(filename) ? 0 : -1; }
+int ct_tracker_load_reparametrization(ct_tracker* t, const char* filename) { return t->tracker.load_reparametrization(filename); }
+
+double ct_tracker_lower_bound(ct_tracker* t)
+{
+  // The costs might have been modified via ct_tracker_get_costs.
+  t->tracker.invalidate_cached_minima();
+  return t->tracker.lower_bound();
+}
 double ct_tracker_evaluate_primal(ct_tracker* t) { return t->tracker.evaluate_primal(); }
+
+int ct_tracker_get_timestep_bounds(ct_tracker* t, double* lower_bounds, size_t lower_bounds_size, double* upper_bounds, size_t upper_bounds_size)
+{
+  const size_t number_of_timesteps = t->tracker.get_graph().timesteps().size();
+  if (lower_bounds_size != number_of_timesteps || upper_bounds_size != number_of_timesteps)
+    return -1;
+
+  t->tracker.invalidate_cached_minima();
+  std::vector<ct::cost> lbs, ubs;
+  t->tracker.bounds_by_timestep(lbs, ubs);
+  std::copy(lbs.begin(), lbs.end(), lower_bounds);
+  std::copy(ubs.begin(), ubs.end(), upper_bounds);
+  return 0;
+}
+
+void ct_tracker_set_gap_focus(ct_tracker* t, int window_size, int sweeps) { t->tracker.set_gap_focus(window_size, sweeps); }
+void ct_tracker_set_tiling(ct_tracker* t, int sweeps, size_t cache_bytes) { t->tracker.set_tiling(sweeps, cache_bytes); }
+void ct_tracker_set_conflict_rounds(ct_tracker* t, int min_rounds, int max_rounds, double tolerance) { t->tracker.set_conflict_rounds(min_rounds, max_rounds, tolerance); }
+void ct_tracker_set_transition_damping(ct_tracker* t, double initial_weight, int ramp_iterations) { t->tracker.set_transition_damping(initial_weight, ramp_iterations); }
+void ct_tracker_set_extrapolation(ct_tracker* t, int interval, double beta) { t->tracker.set_extrapolation(interval, beta); }
+void ct_tracker_set_parallel(ct_tracker* t, int threads) { t->tracker.set_parallel(threads); }
 void ct_tracker_forward_step(ct_tracker* t, int timestep) { t->tracker.single_step<true>(timestep); }
 void ct_tracker_backward_step(ct_tracker* t, int timestep) { t->tracker.single_step<false>(timestep); }
 
+int ct_tracker_get_primals(ct_tracker* t, int* detections, size_t detections_size, int* transitions, size_t transitions_size, int* divisions, size_t divisions_size)
+{
+  const auto& g = t->tracker.get_graph();
+  if (detections_size != g.number_of_detections() ||
+      transitions_size != g.number_of_transitions() ||
+      divisions_size != g.number_of_divisions())
+    return -1;
+
+  const ct::graph_primals<graph_type> primals(g);
+  ct::solution::extract_detections(g, primals, detections);
+  ct::solution::extract_transitions(g, primals, transitions);
+  ct::solution::extract_divisions(g, primals, divisions);
+  return 0;
+}
+
+int ct_tracker_get_committed_primals(ct_tracker* t, int* detections, size_t detections_size, int* transitions, size_t transitions_size, int* divisions, size_t divisions_size)
+{
+  if (ct_tracker_get_primals(t, detections, detections_size, transitions, transitions_size, divisions, divisions_size) != 0)
+    return -1;
+
+  const auto& g = t->tracker.get_graph();
+  const auto committed = t->tracker.number_of_committed_timesteps();
+  const auto& timesteps = g.timesteps();
+  for (ct::index timestep = 0; timestep < timesteps.size(); ++timestep) {
+    for (size_t i = 0; i < timesteps[timestep].detections.size(); ++i) {
+      if (timestep >= committed)
+        *detections = -1;
+      ++detections;
+    }
+  }
+
+  auto is_committed = [committed](const ct::outgoing_slot& s) { return s.timestep + 1 < committed; };
+  for (const auto& s : g.transitions()) {
+    if (!is_committed(s))
+      *transitions = -1;
+    ++transitions;
+  }
+
+  for (const auto& s : g.divisions()) {
+    if (!is_committed(s))
+      *divisions = -1;
+    ++divisions;
+  }
+  return 0;
+}
+
+int ct_tracker_get_snapshot(ct_tracker* t, int* detections, size_t detections_size, int* transitions, size_t transitions_size, int* divisions, size_t divisions_size, double* lower_bound, double* upper_bound)
+{
+  const auto& g = t->tracker.get_graph();
+  if (detections_size != g.number_of_detections() ||
+      transitions_size != g.number_of_transitions() ||
+      divisions_size != g.number_of_divisions())
+    return -2;
+
+  auto [snapshot, lb, iterations] = t->tracker.snapshot();
+  if (!snapshot)
+    return -1;
+
+  const ct::stored_primals primals(g, snapshot->detections);
+  ct::solution::extract_detections(g, primals, detections);
+  ct::solution::extract_transitions(g, primals, transitions);
+  ct::solution::extract_divisions(g, primals, divisions);
+  *lower_bound = lb;
+  *upper_bound = snapshot->upper_bound;
+  return iterations;
+}
+
+int ct_tracker_write_solution(ct_tracker* t, const char* filename, const int* detection_ids, size_t detection_ids_size, const int* appearance_ids, size_t appearance_ids_size, const int* disappearance_ids, size_t disappearance_ids_size, const int* transition_ids, size_t transition_ids_size, const int* division_ids, size_t division_ids_size)
+{
+  const auto& g = t->tracker.get_graph();
+  if (detection_ids_size != g.number_of_detections() ||
+      appearance_ids_size != g.number_of_detections() ||
+      disappearance_ids_size != g.number_of_detections() ||
+      transition_ids_size != g.number_of_transitions() ||
+      division_ids_size != g.number_of_divisions())
+    return -1;
+
+  std::ofstream out(filename);
+  const ct::graph_primals<graph_type> primals(g);
+  ct::solution::write(g, primals, out, detection_ids, appearance_ids, disappearance_ids, transition_ids, division_ids);
+  out.close();
+  return out.fail() ? -1 : 0;
+}
+
+double* ct_tracker_get_costs(ct_tracker* t) { return t->costs(); }
+size_t ct_tracker_get_number_of_costs(ct_tracker* t) { return t->cost_memory.used() / sizeof(ct::cost); }
+size_t ct_tracker_get_memory_usage(ct_tracker* t) { return t->memory.used() + t->cost_memory.used(); }
+
+int ct_tracker_get_detection_layout(ct_tracker* t, long long* layout, size_t layout_size)
+{
+  if (layout_size != 5 * t->tracker.get_graph().number_of_detections())
+    return -1;
+
+  for (const auto& timestep : t->tracker.get_graph().timesteps()) {
+    for (const auto* node : timestep.detections) {
+      const auto begin = t->offset(node->factor.data());
+      const auto number_of_incoming = node->incoming.size() + 1;
+      const auto number_of_outgoing = node->outgoing.size() + 1;
+      *layout++ = begin;
+      *layout++ = begin + 1;
+      *layout++ = begin + 1 + number_of_incoming;
+      *layout++ = begin + 1 + number_of_incoming;
+      *layout++ = begin + 1 + number_of_incoming + number_of_outgoing;
+    }
+  }
+  return 0;
+}
+
+int ct_tracker_get_conflict_layout(ct_tracker* t, long long* layout, size_t layout_size)
+{
+  if (layout_size != 2 * t->tracker.get_graph().number_of_conflicts())
+    return -1;
+
+  for (const auto& timestep : t->tracker.get_graph().timesteps()) {
+    for (const auto* node : timestep.conflicts) {
+      const auto begin = t->offset(node->factor.data());
+      *layout++ = begin;
+      *layout++ = begin + node->factor.size();
+    }
+  }
+  return 0;
+}
+
 //
 // detection API
 //
@@ -1,7 +1,7 @@
 from .gurobi import Gurobi, GurobiStandardModel, GurobiDecomposedModel
 from .model import Model
 from .primals import Primals
-from .tracker import Tracker, construct_tracker, extract_primals_from_tracker
-from .txt import parse_txt_model, convert_txt_to_ct, format_txt_primals
+from .tracker import Tracker, construct_tracker, extract_primals_from_tracker, extract_primals_from_snapshot
+from .txt import parse_txt_model, convert_txt_to_ct, format_txt_primals, native_solution_ids
 
 from . import utils
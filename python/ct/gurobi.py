@@ -310,35 +310,29 @@ class GurobiDecomposedModel(GurobiBase):
         called, and (3) the full model was built.
         """
         assert self._timesteps is None
-        graph = lib.tracker_get_graph(self.tracker.tracker)
+        costs = self.tracker.costs(writable=True)
 
-        for t in range(self.model.no_timesteps()):
-            for d in range(self.model.no_detections(t)):
-                factor = lib.graph_get_detection(graph, t, d)
-                variables = self._detections[t, d]
+        detection_layout = self.tracker.detection_layout()
+        for (t, d), layout in zip(self.model.detection_keys(), detection_layout):
+            offset, incoming_begin, incoming_end, outgoing_begin, outgoing_end = layout
+            variables = self._detections[t, d]
 
-                on_cost = variables.detection.RC
-                off_cost = variables.detection_slack.RC
-                lib.detection_set_detection_cost(factor, on_cost - off_cost)
+            on_cost = variables.detection.RC
+            off_cost = variables.detection_slack.RC
+            costs[offset] = on_cost - off_cost
 
-                assert len(variables.incoming) == self.model.no_incoming_edges(t, d) + 1
-                for i in range(self.model.no_incoming_edges(t, d)):
-                    lib.detection_set_incoming_cost(factor, i, variables.incoming[i].RC)
-                lib.detection_set_appearance_cost(factor, variables.incoming[-1].RC)
+            assert len(variables.incoming) == incoming_end - incoming_begin
+            costs[incoming_begin:incoming_end] = [v.RC for v in variables.incoming]
 
-                assert len(variables.outgoing) == self.model.no_outgoing_edges(t, d) + 1
-                for i in range(self.model.no_outgoing_edges(t, d)):
-                    lib.detection_set_outgoing_cost(factor, i, variables.outgoing[i].RC)
-                lib.detection_set_disappearance_cost(factor, variables.outgoing[-1].RC)
-
-            for c in range(self.model.no_conflicts(t)):
-                factor = lib.graph_get_conflict(graph, t, c)
-                variables = self._conflicts[t, c]
-                detections = self.model._conflicts[t, c]
+            assert len(variables.outgoing) == outgoing_end - outgoing_begin
+            costs[outgoing_begin:outgoing_end] = [v.RC for v in variables.outgoing]
 
-                assert len(detections) + 1 == len(variables)
-                for i in range(len(detections)):
-                    lib.conflict_set_cost(factor, i, variables[i].RC - variables[-1].RC)
+        conflict_keys = ((t, c) for t in range(self.model.no_timesteps()) for c in range(self.model.no_conflicts(t)))
+        conflict_layout = self.tracker.conflict_layout()
+        for (t, c), (begin, end) in zip(conflict_keys, conflict_layout):
+            variables = self._conflicts[t, c]
+            assert len(variables) == end - begin
+            costs[begin:end-1] = [v.RC - variables[-1].RC for v in variables[:-1]]
 
         assert abs(self.gurobi.ObjBound - self.tracker.lower_bound()) < 1e-4
 
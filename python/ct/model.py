@@ -97,6 +97,12 @@ class Model:
     def no_conflicts(self, timestep):
         return self._no_conflicts.get(timestep, 0)
 
+    def detection_keys(self):
+        """Yields all detection keys in the order used by the native library."""
+        for timestep in range(self.no_timesteps()):
+            for detection in range(self.no_detections(timestep)):
+                yield timestep, detection
+
     def dump(self):
         lines = ['m = ct.Model()']
 
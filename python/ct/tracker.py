@@ -1,10 +1,26 @@
+import array
+import itertools
+
 from . import libct as lib
 from .primals import Primals
 
 
 class Tracker:
-    def __init__(self):
-        self.tracker = lib.tracker_create()
+    def __init__(self, directory=None, lookahead=2):
+        """Creates an empty tracker.
+
+        If `directory` is given, the model is stored in temporary files in
+        this directory and only a window of timesteps around the current
+        sweep position is kept in RAM (`lookahead` timesteps are prefetched).
+        """
+        self.tracker = None
+        if directory is None:
+            self.tracker = lib.tracker_create()
+        else:
+            self.tracker = lib.tracker_create_file_backed(directory, lookahead)
+            if self.tracker is None:
+                raise IOError('Could not create storage in {}'.format(directory))
+        self._progress_callback = None
 
     def __del__(self):
         self.destroy()
@@ -14,24 +30,326 @@ class Tracker:
             lib.tracker_destroy(self.tracker)
             self.tracker = None
 
+    def reset(self):
+        """Discards the model but keeps memory and solver environment for reuse."""
+        lib.tracker_reset(self.tracker)
+
     def lower_bound(self):
         return lib.tracker_lower_bound(self.tracker)
 
     def evaluate_primal(self):
         return lib.tracker_evaluate_primal(self.tracker)
 
+    def timestep_bounds(self):
+        """Returns the per-timestep contributions to the lower and upper bound.
+
+        Both are `array.array('d')` with one entry per timestep, their
+        difference is the local share of the gap.
+        """
+        n = lib.graph_get_number_of_timesteps(lib.tracker_get_graph(self.tracker))
+        lower_bounds = array.array('d', [0.0]) * n
+        upper_bounds = array.array('d', [0.0]) * n
+        if lib.tracker_get_timestep_bounds(self.tracker, lower_bounds, upper_bounds) != 0:
+            raise ValueError('Bound buffers do not match the graph')
+        return lower_bounds, upper_bounds
+
+    def set_gap_focus(self, window_size, sweeps):
+        """Extra sweeps per batch over the window with the largest local gap (0 disables)."""
+        lib.tracker_set_gap_focus(self.tracker, window_size, sweeps)
+
+    def set_tiling(self, sweeps, cache_bytes=0):
+        """Cache-blocked message passing with `sweeps` sweeps per tile (0 disables).
+
+        Tiles of consecutive timesteps fill half of `cache_bytes` (0 selects
+        the L2 cache).
+        """
+        lib.tracker_set_tiling(self.tracker, sweeps, cache_bytes)
+
+    def set_conflict_rounds(self, min_rounds, max_rounds, tolerance=0.0):
+        """Adaptive number of conflict message rounds per step (default: fixed 5)."""
+        lib.tracker_set_conflict_rounds(self.tracker, min_rounds, max_rounds, tolerance)
+
+    def set_transition_damping(self, initial_weight, ramp_iterations):
+        """Transition message weight ramping from `initial_weight` to 1."""
+        lib.tracker_set_transition_damping(self.tracker, initial_weight, ramp_iterations)
+
+    def set_extrapolation(self, interval, beta=1.0):
+        """Safeguarded extrapolation of the costs every `interval` iterations (0 disables)."""
+        lib.tracker_set_extrapolation(self.tracker, interval, beta)
+
+    def set_parallel(self, threads):
+        """Even/odd parallel message passing on `threads` threads (1 is sequential)."""
+        lib.tracker_set_parallel(self.tracker, threads)
+
     def run(self, max_iterations=1000):
+        """Runs the solver. The GIL is released while solving."""
         lib.tracker_run(self.tracker, max_iterations)
 
+    def run_window(self, max_iterations=1000, max_seconds=float('inf')):
+        """Online mode: Optimizes the most recent timesteps and commits older ones.
+
+        Timesteps can be appended to the graph between calls (the tracker must
+        not be finalized). Only the last `window_size` timesteps are optimized,
+        all older timesteps are committed afterwards. The call returns after
+        `max_iterations` or once the (soft) time budget `max_seconds` is used
+        up. The GIL is released while solving.
+        """
+        lib.tracker_run_window(self.tracker, max_iterations, max_seconds)
+
+    def set_window_size(self, window_size):
+        lib.tracker_set_window_size(self.tracker, window_size)
+
+    def commit_window(self):
+        """Commits all remaining timesteps, e.g. at the end of an experiment."""
+        lib.tracker_commit_window(self.tracker)
+
+    def number_of_committed_timesteps(self):
+        return lib.tracker_get_number_of_committed_timesteps(self.tracker)
+
+    def add_costs(self, detections=None, appearances=None, disappearances=None, transitions=None, divisions=None):
+        """Applies cost changes to an already solved tracker.
+
+        Every argument is an array of float64 deltas (e.g. `array('d')` or a
+        NumPy array) in the enumeration order of `get_primals`, omitted
+        arguments are treated as zero. The deltas are applied on top of the
+        current reparametrization, call `resolve` afterwards.
+        """
+        g = lib.tracker_get_graph(self.tracker)
+        def deltas(x, size):
+            return array.array('d', [0.0]) * size if x is None else x
+        number_of_detections = lib.graph_get_number_of_detections(g)
+        result = lib.tracker_add_costs(self.tracker,
+            deltas(detections, number_of_detections),
+            deltas(appearances, number_of_detections),
+            deltas(disappearances, number_of_detections),
+            deltas(transitions, lib.graph_get_number_of_transitions(g)),
+            deltas(divisions, lib.graph_get_number_of_divisions(g)))
+        if result != 0:
+            raise ValueError('Cost deltas do not match the graph')
+
+    def resolve(self, max_iterations=100, margin=10):
+        """Continues solving after `add_costs`, restricted to the touched timesteps."""
+        lib.tracker_resolve(self.tracker, max_iterations, margin)
+
+    def save_state(self, filename):
+        """Stores the solver state (costs, best primal, bounds, iterations)."""
+        if lib.tracker_save_state(self.tracker, filename) != 0:
+            raise IOError('Could not write solver state to {}'.format(filename))
+
+    def load_state(self, filename):
+        """Restores a state saved for a tracker with the same graph structure."""
+        if lib.tracker_load_state(self.tracker, filename) != 0:
+            raise IOError('Could not load solver state from {}'.format(filename))
+
+    def initialize(self):
+        """Improves the initial cost distribution in one sweep (before `run`)."""
+        lib.tracker_initialize(self.tracker)
+
+    def save_reparametrization(self, filename):
+        """Stores the distribution of the transition and conflict costs."""
+        if lib.tracker_save_reparametrization(self.tracker, filename) != 0:
+            raise IOError('Could not write reparametrization to {}'.format(filename))
+
+    def load_reparametrization(self, filename):
+        """Warm start from the reparametrization of a related model.
+
+        Returns the number of transitions, divisions and conflict slots that
+        exist in both models and were applied.
+        """
+        result = lib.tracker_load_reparametrization(self.tracker, filename)
+        if result < 0:
+            raise IOError('Could not load reparametrization from {}'.format(filename))
+        return result
+
+    def set_checkpoint(self, filename, interval_seconds):
+        """Periodically saves the state during `run` (`None` disables it)."""
+        lib.tracker_set_checkpoint(self.tracker, filename, interval_seconds)
+
+    def set_batch_size(self, batch_size):
+        lib.tracker_set_batch_size(self.tracker, batch_size)
+
+    def set_verbose(self, verbose):
+        lib.tracker_set_verbose(self.tracker, 1 if verbose else 0)
+
+    def set_handle_signals(self, enabled):
+        """Stops `run` gracefully on SIGINT (opt-in, shared by the process)."""
+        lib.tracker_set_handle_signals(self.tracker, 1 if enabled else 0)
+
+    def cancel(self):
+        """Stops a running `run` early. Can be called from any thread."""
+        lib.tracker_cancel(self.tracker)
+
+    def set_progress_callback(self, callback):
+        """Sets a callable that is invoked once per batch of `run`.
+
+        The callable receives a dict with the keys `iterations`, `lower_bound`,
+        `upper_bound`, `gap`, `seconds`, `seconds_messages`, `seconds_rounding`
+        and `seconds_bounds`. If it returns a true value, the solver stops after
+        the current batch. Pass None to remove the callback.
+        """
+        self._progress_callback = callback
+        lib.tracker_set_python_progress_callback(self.tracker, callback)
+
+    def set_instrumentation(self, enabled):
+        """Enables per-phase timing and counters for subsequent runs."""
+        lib.tracker_set_instrumentation(self.tracker, 1 if enabled else 0)
+
+    def set_hardware_counters(self, enabled):
+        """Samples hardware counters per phase when instrumentation is enabled.
+
+        Returns False if perf events are not available on this system.
+        """
+        return lib.tracker_set_hardware_counters(self.tracker, 1 if enabled else 0) == 0
+
+    def instrumentation(self):
+        """Statistics of the most recent run.
+
+        Returns a dict with the `total` over the run and the lists `batches`
+        and `timesteps`. Every entry is a dict of `seconds_*` per phase and
+        counters, see `ct_instrumentation` in `ct.h`.
+        """
+        return lib.tracker_get_python_instrumentation(self.tracker)
+
+    def write_instrumentation(self, filename):
+        """Writes the statistics of the most recent run as JSON."""
+        if lib.tracker_write_instrumentation(self.tracker, filename) != 0:
+            raise IOError('Could not write instrumentation to {}'.format(filename))
+
+    def set_trace(self, filename, events_per_thread=0):
+        """Writes a Chrome trace-event timeline of every subsequent run.
+
+        The file can be opened with chrome://tracing or ui.perfetto.dev. At
+        most `events_per_thread` events are kept per thread (0 selects the
+        default). Pass None to disable tracing.
+        """
+        lib.tracker_set_trace(self.tracker, filename, events_per_thread)
+
     def forward_step(self, timestep):
         lib.tracker_forward_step(self.tracker, timestep)
 
     def backward_step(self, timestep):
         lib.tracker_backward_step(self.tracker, timestep)
 
-
-def construct_tracker(model):
-    t = Tracker()
+    def get_primals(self):
+        """Returns the on/off flags of all detections, transitions and divisions.
+
+        The flags are returned as three `array.array` objects. Detections are
+        ordered timestep by timestep, transitions and divisions in the order in
+        which they were added to the graph.
+        """
+        detections, transitions, divisions = self._primal_buffers()
+        if lib.tracker_get_primals(self.tracker, detections, transitions, divisions) != 0:
+            raise ValueError('Primal buffers do not match the graph')
+        return detections, transitions, divisions
+
+    def get_committed_primals(self):
+        """Same as `get_primals`, but uncommitted decisions are marked with -1."""
+        detections, transitions, divisions = self._primal_buffers()
+        if lib.tracker_get_committed_primals(self.tracker, detections, transitions, divisions) != 0:
+            raise ValueError('Primal buffers do not match the graph')
+        return detections, transitions, divisions
+
+    def get_snapshot(self):
+        """Returns the best primal found so far by a (possibly still running) `run`.
+
+        The result is a dictionary with the flags (as in `get_primals`), the
+        lower bound, the upper bound of the primal and the iteration count or
+        `None` if no feasible primal has been found yet. Safe to call from
+        another thread while `run` is active.
+        """
+        detections, transitions, divisions = self._primal_buffers()
+        iterations, lb, ub = lib.tracker_get_snapshot(self.tracker, detections, transitions, divisions)
+        if iterations == -2:
+            raise ValueError('Primal buffers do not match the graph')
+        if iterations < 0:
+            return None
+        return {'detections': detections, 'transitions': transitions, 'divisions': divisions,
+                'lower_bound': lb, 'upper_bound': ub, 'iterations': iterations}
+
+    def _primal_buffers(self):
+        g = lib.tracker_get_graph(self.tracker)
+        return (array.array('i', [0]) * lib.graph_get_number_of_detections(g),
+                array.array('i', [0]) * lib.graph_get_number_of_transitions(g),
+                array.array('i', [0]) * lib.graph_get_number_of_divisions(g))
+
+    def costs(self, writable=False):
+        """Returns all (reparametrized) costs as a flat NumPy array.
+
+        No data is copied, the array refers to the memory of the tracker and
+        keeps the `Tracker` alive. The array becomes invalid when the model
+        changes, i.e. after `reset`, `destroy` or `construct_tracker` with
+        this tracker (the memory may be moved or freed). If `writable` is
+        set, modifications are visible to the solver (e.g. for warm starts).
+        Use `detection_layout` and `conflict_layout` to locate the costs of
+        a specific factor.
+        """
+        import numpy
+        view = lib.tracker_get_cost_view(self.tracker, self, 1 if writable else 0)
+        return numpy.frombuffer(view, dtype=numpy.float64)
+
+    def detection_layout(self):
+        """Returns the slices of all detections within `costs()`.
+
+        The result is an (n, 5) array containing per detection the offset of
+        the detection cost, begin/end of the incoming costs (the last one is
+        the appearance cost) and begin/end of the outgoing costs (the last one
+        is the disappearance cost).
+        """
+        import numpy
+        g = lib.tracker_get_graph(self.tracker)
+        layout = numpy.empty((lib.graph_get_number_of_detections(g), 5), dtype=numpy.int64)
+        if lib.tracker_get_detection_layout(self.tracker, layout) != 0:
+            raise ValueError('Layout buffer does not match the graph')
+        return layout
+
+    def conflict_layout(self):
+        """Returns the slices of all conflicts within `costs()`.
+
+        The result is an (n, 2) array containing per conflict begin/end of its
+        costs. The last cost belongs to the state where no detection is active.
+        """
+        import numpy
+        g = lib.tracker_get_graph(self.tracker)
+        layout = numpy.empty((lib.graph_get_number_of_conflicts(g), 2), dtype=numpy.int64)
+        if lib.tracker_get_conflict_layout(self.tracker, layout) != 0:
+            raise ValueError('Layout buffer does not match the graph')
+        return layout
+
+    def write_solution(self, filename, detection_ids, appearance_ids, disappearance_ids, transition_ids, division_ids):
+        """Writes the current primals in the `tracking.sol` format.
+
+        All id arguments are `array.array('i')` objects in the same order as
+        returned by `get_primals`. See `ct.txt.native_solution_ids`.
+        """
+        g = lib.tracker_get_graph(self.tracker)
+        number_of_detections = lib.graph_get_number_of_detections(g)
+        _check_sizes(detection_ids=(detection_ids, number_of_detections),
+                     appearance_ids=(appearance_ids, number_of_detections),
+                     disappearance_ids=(disappearance_ids, number_of_detections),
+                     transition_ids=(transition_ids, lib.graph_get_number_of_transitions(g)),
+                     division_ids=(division_ids, lib.graph_get_number_of_divisions(g)))
+        result = lib.tracker_write_solution(self.tracker, filename, detection_ids, appearance_ids,
+                                            disappearance_ids, transition_ids, division_ids)
+        if result != 0:
+            raise IOError('Could not write solution to {}'.format(filename))
+
+
+def _check_sizes(**arrays):
+    """Raises `ValueError` unless every buffer has the expected number of items."""
+    for name, (buffer, expected) in arrays.items():
+        view = memoryview(buffer)
+        if view.nbytes // max(view.itemsize, 1) != expected:
+            raise ValueError('{} has {} items, expected {}'.format(
+                name, view.nbytes // max(view.itemsize, 1), expected))
+
+
+def construct_tracker(model, directory=None, tracker=None):
+    """Builds a tracker for `model`, reusing (and resetting) `tracker` if given."""
+    if tracker is None:
+        t = Tracker(directory)
+    else:
+        t = tracker
+        t.reset()
     g = lib.tracker_get_graph(t.tracker)
 
     detection_map = {} # (timestep, detection) -> detection_object
@@ -74,18 +392,15 @@ def construct_tracker(model):
         timestep, index_from, index_to = k
         slot_left, slot_right, cost = v
 
-        lib.detection_set_outgoing_cost(detection_map[timestep, index_from], slot_left, cost * .5)
-        lib.detection_set_incoming_cost(detection_map[timestep + 1, index_to], slot_right, cost * .5)
         lib.graph_add_transition(g, timestep, index_from, slot_left, index_to, slot_right)
+        lib.graph_set_transition_cost(g, timestep, index_from, slot_left, cost)
 
     for k, v in model._divisions.items():
         timestep, index_from, index_to_1, index_to_2 = k
         slot_left, slot_right_1, slot_right_2, cost = v
 
-        lib.detection_set_outgoing_cost(detection_map[timestep, index_from], slot_left, cost / 3.0)
-        lib.detection_set_incoming_cost(detection_map[timestep + 1, index_to_1], slot_right_1, cost / 3.0)
-        lib.detection_set_incoming_cost(detection_map[timestep + 1, index_to_2], slot_right_2, cost / 3.0)
         lib.graph_add_division(g, timestep, index_from, slot_left, index_to_1, slot_right_1, index_to_2, slot_right_2)
+        lib.graph_set_transition_cost(g, timestep, index_from, slot_left, cost)
 
     lib.tracker_finalize(t.tracker)
 
@@ -93,49 +408,26 @@ def construct_tracker(model):
 
 
 def extract_primals_from_tracker(model, tracker):
-    incoming_slot_to_transition = {}
-    outgoing_slot_to_transition = {}
-    for key, (slot_left, slot_right, _) in model._transitions.items():
-        timestep, detection_left, detection_right = key
-        outgoing_slot_to_transition[timestep, detection_left, slot_left] = key
-        incoming_slot_to_transition[timestep+1, detection_right, slot_right] = key
-
-    incoming_slot_to_division = {}
-    outgoing_slot_to_division = {}
-    for key, (slot_left, slot_right_1, slot_right_2, _) in model._divisions.items():
-        timestep, detection_left, detection_right_1, detection_right_2 = key
-        outgoing_slot_to_division[timestep, detection_left, slot_left] = key
-        incoming_slot_to_division[timestep+1, detection_right_1, slot_right_1] = key
-        incoming_slot_to_division[timestep+1, detection_right_2, slot_right_2] = key
-
-    g = lib.tracker_get_graph(tracker.tracker)
+    return primals_from_flags(model, *tracker.get_primals())
+
+
+def extract_primals_from_snapshot(model, tracker):
+    snapshot = tracker.get_snapshot()
+    if snapshot is None:
+        return None
+    return primals_from_flags(model, snapshot['detections'], snapshot['transitions'], snapshot['divisions'])
+
+
+def primals_from_flags(model, detections, transitions, divisions):
     primals = Primals(model)
-    for timestep in range(model.no_timesteps()):
-        for detection in range(model.no_detections(timestep)):
-            factor = lib.graph_get_detection(g, timestep, detection)
-            incoming_primal = lib.detection_get_incoming_primal(factor)
-            outgoing_primal = lib.detection_get_outgoing_primal(factor)
-
-            assert (incoming_primal == -1) == (outgoing_primal == -1)
-            primals.detection(timestep, detection, (incoming_primal != -1) and (outgoing_primal != -1))
-
-            if incoming_primal >= 0 and incoming_primal < model.no_incoming_edges(timestep, detection):
-                key = incoming_slot_to_transition.get((timestep, detection, incoming_primal))
-                if key is not None:
-                    primals.transition(*key, True)
-
-                key = incoming_slot_to_division.get((timestep, detection, incoming_primal))
-                if key is not None:
-                    primals.division(*key, True)
-
-            if outgoing_primal >= 0 and outgoing_primal < model.no_outgoing_edges(timestep, detection):
-                key = outgoing_slot_to_transition.get((timestep, detection, outgoing_primal))
-                if key is not None:
-                    primals.transition(*key, True)
-
-                key = outgoing_slot_to_division.get((timestep, detection, outgoing_primal))
-                if key is not None:
-                    primals.division(*key, True)
+    for key in itertools.compress(model.detection_keys(), detections):
+        primals.detection(*key, True)
+
+    for key in itertools.compress(model._transitions.keys(), transitions):
+        primals.transition(*key, True)
+
+    for key in itertools.compress(model._divisions.keys(), divisions):
+        primals.division(*key, True)
 
     assert primals.check_consistency()
     return primals
@@ -1,3 +1,4 @@
+import array
 import re
 
 from .model import Model
@@ -238,3 +239,24 @@ def format_txt_primals(primals, bimaps, out):
 
     for timestep, detection_left, detection_right_1, detection_right_2 in primals._divisions:
         out.write('DIV {}\n'.format(unique_id('DIV', timestep, detection_left, detection_right_1, detection_right_2)))
+
+
+def native_solution_ids(model, bimaps):
+    """Returns the unique ids in the order expected by `Tracker.write_solution`.
+
+    Missing appearance and disappearance variables are mapped to -1.
+    """
+    model_to_id, id_to_model = bimaps
+
+    def unique_id(*args):
+        tag, unique_id = model_to_id.get(args, (None, -1))
+        return unique_id
+
+    detection_keys = list(model.detection_keys())
+    detection_ids = array.array('i', (unique_id('H', *k) for k in detection_keys))
+    appearance_ids = array.array('i', (unique_id('APP', *k) for k in detection_keys))
+    disappearance_ids = array.array('i', (unique_id('DISAPP', *k) for k in detection_keys))
+    transition_ids = array.array('i', (unique_id('MOVE', *k) for k in model._transitions.keys()))
+    division_ids = array.array('i', (unique_id('DIV', *k) for k in model._divisions.keys()))
+
+    return detection_ids, appearance_ids, disappearance_ids, transition_ids, division_ids
@@ -1,7 +1,288 @@
-%module libct
+%module(threads="1") libct
 %{
   #include <ct.h>
 %}
 
+%include <typemaps.i>
+
+// The GIL is only released while solving and during calls that sweep over
+// the whole model or do file I/O, all other calls are too short to benefit
+// from it.
+%nothread;
+%thread ct_tracker_run;
+%thread ct_tracker_run_window;
+%thread ct_tracker_resolve;
+%thread ct_tracker_initialize;
+%thread ct_tracker_save_state;
+%thread ct_tracker_load_state;
+%thread ct_tracker_save_reparametrization;
+%thread ct_tracker_load_reparametrization;
+
+//
+// Contiguous arrays (e.g. `array.array` or NumPy arrays) are passed through
+// the Python buffer protocol, so no element-wise conversion takes place.
+//
+
+%define %ct_buffer_typemaps(TYPE, FORMATS)
+%typemap(in) (TYPE* BUFFER, size_t SIZE) (Py_buffer view, int has_view = 0) {
+  if (PyObject_GetBuffer($input, &view, PyBUF_WRITABLE | PyBUF_FORMAT | PyBUF_ND) != 0)
+    SWIG_fail;
+  has_view = 1;
+  if (view.itemsize != sizeof(TYPE) || !strchr(FORMATS, view.format[strlen(view.format) - 1])) {
+    PyErr_SetString(PyExc_TypeError, "buffer has wrong item type");
+    SWIG_fail;
+  }
+  $1 = (TYPE*) view.buf;
+  $2 = (size_t) (view.len / view.itemsize);
+}
+
+%typemap(freearg) (TYPE* BUFFER, size_t SIZE) {
+  if (has_view$argnum)
+    PyBuffer_Release(&view$argnum);
+}
+
+%typemap(in) (const TYPE* BUFFER, size_t SIZE) (Py_buffer view, int has_view = 0) {
+  if (PyObject_GetBuffer($input, &view, PyBUF_FORMAT | PyBUF_ND) != 0)
+    SWIG_fail;
+  has_view = 1;
+  if (view.itemsize != sizeof(TYPE) || !strchr(FORMATS, view.format[strlen(view.format) - 1])) {
+    PyErr_SetString(PyExc_TypeError, "buffer has wrong item type");
+    SWIG_fail;
+  }
+  $1 = (TYPE*) view.buf;
+  $2 = (size_t) (view.len / view.itemsize);
+}
+
+%typemap(freearg) (const TYPE* BUFFER, size_t SIZE) {
+  if (has_view$argnum)
+    PyBuffer_Release(&view$argnum);
+}
+%enddef
+
+%ct_buffer_typemaps(int, "i")
+%ct_buffer_typemaps(long long, "lq")
+%ct_buffer_typemaps(double, "d")
+
+%apply (int* BUFFER, size_t SIZE) {
+  (int* detections, size_t detections_size),
+  (int* transitions, size_t transitions_size),
+  (int* divisions, size_t divisions_size)
+};
+
+%apply (const int* BUFFER, size_t SIZE) {
+  (const int* detection_ids, size_t detection_ids_size),
+  (const int* appearance_ids, size_t appearance_ids_size),
+  (const int* disappearance_ids, size_t disappearance_ids_size),
+  (const int* transition_ids, size_t transition_ids_size),
+  (const int* division_ids, size_t division_ids_size)
+};
+
+%apply (const double* BUFFER, size_t SIZE) {
+  (const double* detection_deltas, size_t detection_deltas_size),
+  (const double* appearance_deltas, size_t appearance_deltas_size),
+  (const double* disappearance_deltas, size_t disappearance_deltas_size),
+  (const double* transition_deltas, size_t transition_deltas_size),
+  (const double* division_deltas, size_t division_deltas_size)
+};
+
+%apply (double* BUFFER, size_t SIZE) {
+  (double* lower_bounds, size_t lower_bounds_size),
+  (double* upper_bounds, size_t upper_bounds_size)
+};
+
+%apply double* OUTPUT { double* lower_bound, double* upper_bound };
+
+%apply (long long* BUFFER, size_t SIZE) {
+  (long long* layout, size_t layout_size)
+};
+
+// The raw pointer is replaced by a `memoryview` onto the same memory.
+%ignore ct_tracker_get_costs;
+
+// Python callables are forwarded through a trampoline, see below.
+%ignore ct_tracker_set_progress_callback;
+
 %rename ("%(strip:[ct_])s") "";
 %include <ct.h>
+
+%{
+  // Called from within ct_tracker_run, i.e. without holding the GIL.
+  // Exceptions raised by the callable are printed and stop the solver.
+  static int ct_python_progress_callback(const ct_progress* p, void* user_data)
+  {
+    PyGILState_STATE state = PyGILState_Ensure();
+    int result = 1;
+
+    PyObject* progress = Py_BuildValue("{s:i,s:d,s:d,s:d,s:d,s:d,s:d,s:d}",
+      "iterations", p->iterations,
+      "lower_bound", p->lower_bound,
+      "upper_bound", p->upper_bound,
+      "gap", p->gap,
+      "seconds", p->seconds,
+      "seconds_messages", p->seconds_messages,
+      "seconds_rounding", p->seconds_rounding,
+      "seconds_bounds", p->seconds_bounds);
+
+    if (progress != NULL) {
+      PyObject* value = PyObject_CallFunctionObjArgs((PyObject*) user_data, progress, NULL);
+      if (value != NULL) {
+        result = PyObject_IsTrue(value);
+        Py_DECREF(value);
+      }
+      Py_DECREF(progress);
+    }
+
+    if (PyErr_Occurred()) {
+      PyErr_Print();
+      result = 1;
+    }
+
+    PyGILState_Release(state);
+    return result;
+  }
+%}
+
+%{
+#define CT_PYTHON_HARDWARE_FORMAT "{s:L,s:L,s:L,s:L}"
+#define CT_PYTHON_HARDWARE(h) \
+  "cycles", (h).cycles, "instructions", (h).instructions, \
+  "llc_misses", (h).llc_misses, "branch_misses", (h).branch_misses
+
+  static PyObject* ct_python_instrumentation(const ct_instrumentation* s)
+  {
+    return Py_BuildValue("{s:i,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:L,s:L,s:L,s:L,s:L,"
+                         "s:" CT_PYTHON_HARDWARE_FORMAT ",s:" CT_PYTHON_HARDWARE_FORMAT ",s:" CT_PYTHON_HARDWARE_FORMAT "}",
+      "iterations", s->iterations,
+      "seconds_conflict_messages", s->seconds_conflict_messages,
+      "seconds_transition_messages", s->seconds_transition_messages,
+      "seconds_subsolver", s->seconds_subsolver,
+      "seconds_rounding_sort", s->seconds_rounding_sort,
+      "seconds_rounding", s->seconds_rounding,
+      "seconds_evaluate_primal", s->seconds_evaluate_primal,
+      "seconds_lower_bound", s->seconds_lower_bound,
+      "seconds_primal_copy", s->seconds_primal_copy,
+      "transition_messages", s->transition_messages,
+      "conflict_messages", s->conflict_messages,
+      "subsolver_calls", s->subsolver_calls,
+      "nodes_rounded", s->nodes_rounded,
+      "candidates_evaluated", s->candidates_evaluated,
+      "hardware_conflict_messages", CT_PYTHON_HARDWARE(s->hardware_conflict_messages),
+      "hardware_transition_messages", CT_PYTHON_HARDWARE(s->hardware_transition_messages),
+      "hardware_rounding", CT_PYTHON_HARDWARE(s->hardware_rounding));
+  }
+%}
+
+%{
+  // Exports the costs of a tracker through the buffer protocol. Unlike a
+  // plain `PyMemoryView_FromMemory`, the exporter holds a reference to the
+  // Python object owning the tracker, so that views (e.g. NumPy arrays) can
+  // not outlive it.
+  typedef struct {
+    PyObject_HEAD
+    ct_tracker* tracker;
+    PyObject* owner;
+    int writable;
+  } ct_cost_exporter;
+
+  static int ct_cost_exporter_getbuffer(PyObject* self, Py_buffer* view, int flags)
+  {
+    ct_cost_exporter* exporter = (ct_cost_exporter*) self;
+    return PyBuffer_FillInfo(view, self, ct_tracker_get_costs(exporter->tracker),
+                             ct_tracker_get_number_of_costs(exporter->tracker) * sizeof(double),
+                             !exporter->writable, flags);
+  }
+
+  static void ct_cost_exporter_dealloc(PyObject* self)
+  {
+    Py_XDECREF(((ct_cost_exporter*) self)->owner);
+    PyObject_Del(self);
+  }
+
+  static PyBufferProcs ct_cost_exporter_buffer = { ct_cost_exporter_getbuffer, NULL };
+  static PyTypeObject ct_cost_exporter_type = { PyVarObject_HEAD_INIT(NULL, 0) };
+%}
+
+%inline %{
+  // Returns a dict with the totals, a list of batches and a list of
+  // timesteps (each entry like ct_instrumentation).
+  PyObject* ct_tracker_get_python_instrumentation(ct_tracker* t)
+  {
+    ct_instrumentation s;
+    PyObject* batches = PyList_New(0);
+    PyObject* timesteps = PyList_New(0);
+    PyObject* total = NULL;
+    PyObject* result = NULL;
+    if (batches == NULL || timesteps == NULL)
+      goto done;
+
+    for (int i = 0; ct_tracker_get_instrumentation(t, i, &s) == 0; ++i) {
+      PyObject* item = ct_python_instrumentation(&s);
+      if (item == NULL || PyList_Append(batches, item) != 0) {
+        Py_XDECREF(item);
+        goto done;
+      }
+      Py_DECREF(item);
+    }
+
+    for (int i = 0; ct_tracker_get_timestep_instrumentation(t, i, &s) == 0; ++i) {
+      PyObject* item = ct_python_instrumentation(&s);
+      if (item == NULL || PyList_Append(timesteps, item) != 0) {
+        Py_XDECREF(item);
+        goto done;
+      }
+      Py_DECREF(item);
+    }
+
+    ct_tracker_get_instrumentation(t, -1, &s);
+    total = ct_python_instrumentation(&s);
+    if (total != NULL)
+      result = Py_BuildValue("{s:O,s:O,s:O}", "total", total, "batches", batches, "timesteps", timesteps);
+
+  done:
+    Py_XDECREF(total);
+    Py_XDECREF(batches);
+    Py_XDECREF(timesteps);
+    return result;
+  }
+
+  // The caller has to keep a reference to `callback` as long as it is set.
+  void ct_tracker_set_python_progress_callback(ct_tracker* t, PyObject* callback)
+  {
+    if (callback == Py_None)
+      ct_tracker_set_progress_callback(t, NULL, NULL);
+    else
+      ct_tracker_set_progress_callback(t, ct_python_progress_callback, callback);
+  }
+
+  // Returns a `memoryview` onto the costs. The view keeps `owner` (the
+  // Python `Tracker`) alive, see `ct_cost_exporter`.
+  PyObject* ct_tracker_get_cost_view(ct_tracker* t, PyObject* owner, int writable)
+  {
+    ct_cost_exporter* exporter;
+    PyObject* view;
+
+    if (ct_cost_exporter_type.tp_name == NULL) {
+      ct_cost_exporter_type.tp_name = "libct.cost_exporter";
+      ct_cost_exporter_type.tp_basicsize = sizeof(ct_cost_exporter);
+      ct_cost_exporter_type.tp_flags = Py_TPFLAGS_DEFAULT;
+      ct_cost_exporter_type.tp_dealloc = ct_cost_exporter_dealloc;
+      ct_cost_exporter_type.tp_as_buffer = &ct_cost_exporter_buffer;
+      if (PyType_Ready(&ct_cost_exporter_type) != 0) {
+        ct_cost_exporter_type.tp_name = NULL;
+        return NULL;
+      }
+    }
+
+    exporter = PyObject_New(ct_cost_exporter, &ct_cost_exporter_type);
+    if (exporter == NULL)
+      return NULL;
+    exporter->tracker = t;
+    exporter->writable = writable;
+    Py_INCREF(owner);
+    exporter->owner = owner;
+
+    view = PyMemoryView_FromObject((PyObject*) exporter);
+    Py_DECREF(exporter);
+    return view;
+  }
+%}